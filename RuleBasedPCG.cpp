@@ -41,487 +41,6828 @@
 
 #include <iostream>
 #include <vector>
+#include <string>
 #include <random>
 #include <chrono>
+#include <algorithm>
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <cstdlib>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <type_traits>
+#include <array>
+#include <cstdio>
+#include <functional>
+#include <new>
+#include <sstream>
+#include <fstream>
+#include <memory>
+#include <limits>
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/resource.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#define PCG_HAS_MMAP 1
+#endif
 
 using Map = std::vector<std::vector<int>>;
 
-void printMap(const Map& map) {
-    std::cout << "--- Current Map ---" << std::endl;
+// Contadores globales de reservas de memoria (todos los hilos), usados por los
+// benchmarks y las pruebas. Solo se cuentan si se compila con
+// -DPCG_ALLOC_COUNTING: reemplazan operator new/delete y suman una operación
+// atómica a cada reserva de cada hilo, así que el binario normal no los lleva.
+// Se definen antes que todo lo demás para que cualquier uso de new/delete del
+// archivo vea los reemplazos
+struct AllocationCounters {
+    uint64_t count = 0;
+    uint64_t bytes = 0;
+};
+
+inline std::atomic<uint64_t>& allocationCount() {
+    static std::atomic<uint64_t> count{0};
+    return count;
+}
+
+inline std::atomic<uint64_t>& allocationBytes() {
+    static std::atomic<uint64_t> bytes{0};
+    return bytes;
+}
+
+inline AllocationCounters allocationSnapshot() {
+    return {allocationCount().load(std::memory_order_relaxed), allocationBytes().load(std::memory_order_relaxed)};
+}
+
+#ifdef PCG_ALLOC_COUNTING
+constexpr bool kAllocationCounting = true;
+
+// GCC no sabe que estos reemplazos emparejan malloc/free y avisa de un falso positivo
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+#endif
+void* operator new(std::size_t size) {
+    allocationCount().fetch_add(1, std::memory_order_relaxed);
+    allocationBytes().fetch_add(size, std::memory_order_relaxed);
+    if (void* p = std::malloc(size ? size : 1)) return p;
+    throw std::bad_alloc();
+}
+void* operator new[](std::size_t size) { return ::operator new(size); }
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete[](void* p) noexcept { std::free(p); }
+void operator delete(void* p, std::size_t) noexcept { std::free(p); }
+void operator delete[](void* p, std::size_t) noexcept { std::free(p); }
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic pop
+#endif
+#else
+constexpr bool kAllocationCounting = false;
+#endif
+
+// Grilla contigua para todas las etapas de generación.
+// Las filas se guardan una tras otra en un único buffer de palabras de 64 bits
+// (una sola reserva de memoria, filas alineadas a 8 bytes), con un stride fijo
+// por fila. Hay dos modos de almacenamiento:
+// - Bits:  1 bit por celda, 64 celdas por palabra (bit b = columna 64*w + b)
+// - Bytes: 1 byte por celda (acceso directo, útil para kernels escalares)
+// Invariante: los bits/bytes de relleno después de la columna W-1 valen 0.
+// Las coordenadas siguen la convención de Map: (i, j) = (fila, columna).
+class Grid {
+public:
+    enum class Storage { Bytes, Bits };
+
+    Grid() = default;
+
+    Grid(int W, int H, Storage storage = Storage::Bits) {
+        reset(W, H, storage);
+    }
+
+    // Redimensiona la grilla y la deja en 0, reutilizando la memoria reservada
+    void reset(int W, int H, Storage storage) {
+        W_ = std::max(0, W);
+        H_ = std::max(0, H);
+        storage_ = storage;
+        stride_ = storage == Storage::Bits ? (static_cast<size_t>(W_) + 63) / 64
+                                           : (static_cast<size_t>(W_) + 7) / 8;
+        words_.assign(stride_ * H_, 0);
+    }
+
+    int width() const { return W_; }
+    int height() const { return H_; }
+    Storage storage() const { return storage_; }
+    bool packed() const { return storage_ == Storage::Bits; }
+
+    // Palabras de 64 bits por fila (en ambos modos)
+    size_t strideWords() const { return stride_; }
+
+    uint64_t* rowWords(int i) { return words_.data() + i * stride_; }
+    const uint64_t* rowWords(int i) const { return words_.data() + i * stride_; }
+    uint8_t* rowBytes(int i) { return reinterpret_cast<uint8_t*>(rowWords(i)); }
+    const uint8_t* rowBytes(int i) const { return reinterpret_cast<const uint8_t*>(rowWords(i)); }
+
+    uint64_t* data() { return words_.data(); }
+    const uint64_t* data() const { return words_.data(); }
+    size_t sizeWords() const { return words_.size(); }
+
+    bool inBounds(int i, int j) const { return i >= 0 && i < H_ && j >= 0 && j < W_; }
+
+    int get(int i, int j) const {
+        if (storage_ == Storage::Bits) {
+            return static_cast<int>((rowWords(i)[j >> 6] >> (j & 63)) & 1);
+        }
+        return rowBytes(i)[j];
+    }
+
+    void set(int i, int j, int value) {
+        if (storage_ == Storage::Bits) {
+            uint64_t mask = uint64_t(1) << (j & 63);
+            uint64_t& word = rowWords(i)[j >> 6];
+            word = value ? (word | mask) : (word & ~mask);
+        } else {
+            rowBytes(i)[j] = value ? 1 : 0;
+        }
+    }
+
+    void clear() { std::fill(words_.begin(), words_.end(), 0); }
+
+    void swap(Grid& other) {
+        std::swap(W_, other.W_);
+        std::swap(H_, other.H_);
+        std::swap(storage_, other.storage_);
+        std::swap(stride_, other.stride_);
+        words_.swap(other.words_);
+    }
+
+    // Copia con otro modo de almacenamiento
+    Grid converted(Storage storage) const {
+        if (storage == storage_) return *this;
+        Grid out(W_, H_, storage);
+        for (int i = 0; i < H_; ++i) {
+            for (int j = 0; j < W_; ++j) {
+                if (get(i, j)) out.set(i, j, 1);
+            }
+        }
+        return out;
+    }
+
+    bool sameCells(const Grid& other) const {
+        if (W_ != other.W_ || H_ != other.H_) return false;
+        if (storage_ == other.storage_) return words_ == other.words_;
+        for (int i = 0; i < H_; ++i) {
+            for (int j = 0; j < W_; ++j) {
+                if (get(i, j) != other.get(i, j)) return false;
+            }
+        }
+        return true;
+    }
+
+    // Adaptadores hacia/desde la representación Map (cualquier valor != 0 es 1)
+    static Grid fromMap(const Map& map, int W, int H, Storage storage = Storage::Bits) {
+        Grid grid(W, H, storage);
+        for (int i = 0; i < H; ++i) {
+            for (int j = 0; j < W; ++j) {
+                if (map[i][j] != 0) grid.set(i, j, 1);
+            }
+        }
+        return grid;
+    }
+
+    static Grid fromMap(const Map& map, Storage storage = Storage::Bits) {
+        int H = static_cast<int>(map.size());
+        int W = H > 0 ? static_cast<int>(map[0].size()) : 0;
+        return fromMap(map, W, H, storage);
+    }
+
+    void toMap(Map& map) const {
+        map.resize(H_);
+        for (int i = 0; i < H_; ++i) {
+            map[i].resize(W_);
+            for (int j = 0; j < W_; ++j) {
+                map[i][j] = get(i, j);
+            }
+        }
+    }
+
+    Map toMap() const {
+        Map map;
+        toMap(map);
+        return map;
+    }
+
+private:
+    int W_ = 0;
+    int H_ = 0;
+    Storage storage_ = Storage::Bits;
+    size_t stride_ = 0;
+    std::vector<uint64_t> words_;
+};
+
+// Lectura/escritura sin comprobación de límites, resueltas en tiempo de compilación
+// según el modo de almacenamiento para que los bucles internos no ramifiquen
+template <Grid::Storage S>
+inline int readCell(const Grid& grid, int i, int j) {
+    if constexpr (S == Grid::Storage::Bits) {
+        return static_cast<int>((grid.rowWords(i)[j >> 6] >> (j & 63)) & 1);
+    } else {
+        return grid.rowBytes(i)[j];
+    }
+}
+
+template <Grid::Storage S>
+inline void writeCell(Grid& grid, int i, int j, int value) {
+    if constexpr (S == Grid::Storage::Bits) {
+        uint64_t mask = uint64_t(1) << (j & 63);
+        uint64_t& word = grid.rowWords(i)[j >> 6];
+        word = value ? (word | mask) : (word & ~mask);
+    } else {
+        grid.rowBytes(i)[j] = static_cast<uint8_t>(value);
+    }
+}
+
+// Máscara de las columnas válidas en la última palabra de una fila empaquetada de ancho W
+inline uint64_t lastWordMask(int W) {
+    return (W & 63) ? (uint64_t(1) << (W & 63)) - 1 : ~uint64_t(0);
+}
+
+// ---------------------------------------------------------------------------
+// Registro (logging) y trazas estructuradas
+// Los mensajes de progreso pasan por PCG_LOG(nivel, expresión). Hay dos filtros:
+// - En compilación: PCG_MAX_LOG_LEVEL (0 = Silent ... 2 = Detail). Los mensajes
+//   por encima de ese nivel desaparecen del binario, incluido su formateo.
+// - En ejecución: setLogLevel() fija el nivel de todo el proceso, y
+//   ScopedThreadLogLevel lo baja solo en el hilo actual (lo usan las funciones
+//   que corren trabajos en varios hilos, sin tocar el nivel global). Con Silent,
+//   cada mensaje cuesta una comparación y no se formatea ni se vacía nada.
+// Los mensajes terminan en '\n' (sin std::endl), así que no fuerzan un vaciado
+// por línea. Las trazas (PCG_TRACE) son eventos JSON por línea escritos en un
+// buffer en memoria y volcados por bloques a un archivo, solo si hay uno abierto.
+// ---------------------------------------------------------------------------
+enum class LogLevel { Silent = 0, Summary = 1, Detail = 2 };
+
+#ifndef PCG_MAX_LOG_LEVEL
+#define PCG_MAX_LOG_LEVEL 2
+#endif
+
+inline std::atomic<int>& logLevelStorage() {
+    static std::atomic<int> level{static_cast<int>(LogLevel::Detail)};
+    return level;
+}
+
+inline void setLogLevel(LogLevel level) {
+    logLevelStorage().store(static_cast<int>(level), std::memory_order_relaxed);
+}
+
+inline LogLevel logLevel() {
+    return static_cast<LogLevel>(logLevelStorage().load(std::memory_order_relaxed));
+}
+
+// Nivel propio del hilo actual; -1 si sigue al global
+inline int& threadLogLevelStorage() {
+    thread_local int level = -1;
+    return level;
+}
+
+inline bool logEnabled(LogLevel level) {
+    const int threadLevel = threadLogLevelStorage();
+    const int globalLevel = logLevelStorage().load(std::memory_order_relaxed);
+    return static_cast<int>(level) <= (threadLevel >= 0 ? std::min(threadLevel, globalLevel) : globalLevel);
+}
+
+#define PCG_LOG(level, expr)                                                              \
+    do {                                                                                  \
+        if (static_cast<int>(LogLevel::level) <= PCG_MAX_LOG_LEVEL && logEnabled(LogLevel::level)) { \
+            std::cout << expr << '\n';                                                    \
+        }                                                                                 \
+    } while (0)
+
+// Cambia el nivel de registro dentro de un ámbito y lo restaura al salir
+class ScopedLogLevel {
+public:
+    explicit ScopedLogLevel(LogLevel level) : previous_(logLevel()) { setLogLevel(level); }
+    ~ScopedLogLevel() { setLogLevel(previous_); }
+
+private:
+    LogLevel previous_;
+};
+
+// Baja el nivel de registro solo en el hilo actual dentro de un ámbito (con
+// active = false no cambia nada). Cada hilo restaura su propio valor, así que
+// ámbitos en hilos distintos no se pisan
+class ScopedThreadLogLevel {
+public:
+    explicit ScopedThreadLogLevel(LogLevel level, bool active = true) : previous_(threadLogLevelStorage()) {
+        if (active) threadLogLevelStorage() = static_cast<int>(level);
+    }
+    ~ScopedThreadLogLevel() { threadLogLevelStorage() = previous_; }
+
+    ScopedThreadLogLevel(const ScopedThreadLogLevel&) = delete;
+    ScopedThreadLogLevel& operator=(const ScopedThreadLogLevel&) = delete;
+
+private:
+    int previous_;
+};
+
+struct TraceField {
+    const char* key;
+    double value;
+};
+
+// Destino de trazas: acumula eventos en memoria y escribe por bloques
+class TraceSink {
+public:
+    static TraceSink& instance() {
+        static TraceSink sink;
+        return sink;
+    }
+
+    bool open(const std::string& path) {
+        close();
+        std::lock_guard<std::mutex> lock(mutex_);
+        file_ = std::fopen(path.c_str(), "w");
+        start_ = std::chrono::steady_clock::now();
+        buffer_.reserve(kFlushBytes + 4096);
+        enabled_.store(file_ != nullptr, std::memory_order_relaxed);
+        return file_ != nullptr;
+    }
+
+    void close() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        enabled_.store(false, std::memory_order_relaxed);
+        if (!file_) return;
+        flushLocked();
+        std::fclose(file_);
+        file_ = nullptr;
+    }
+
+    bool enabled() const { return enabled_.load(std::memory_order_relaxed); }
+
+    // {"ts": microsegundos, "event": name, key: value, ...}
+    void write(const char* name, std::initializer_list<TraceField> fields) {
+        const auto now = std::chrono::steady_clock::now();
+        char line[512];
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!file_) return;
+        double ts = std::chrono::duration<double, std::micro>(now - start_).count();
+        int n = std::snprintf(line, sizeof(line), "{\"ts\":%.1f,\"event\":\"%s\"", ts, name);
+        for (const TraceField& field : fields) {
+            if (n >= static_cast<int>(sizeof(line)) - 64) break;
+            n += std::snprintf(line + n, sizeof(line) - n, ",\"%s\":%.17g", field.key, field.value);
+        }
+        n += std::snprintf(line + n, sizeof(line) - n, "}\n");
+        buffer_.append(line, std::min<size_t>(n, sizeof(line) - 1));
+        if (buffer_.size() >= kFlushBytes) flushLocked();
+    }
+
+    ~TraceSink() { close(); }
+
+private:
+    static constexpr size_t kFlushBytes = 1 << 20;
+
+    void flushLocked() {
+        if (file_ && !buffer_.empty()) std::fwrite(buffer_.data(), 1, buffer_.size(), file_);
+        buffer_.clear();
+    }
+
+    std::mutex mutex_;
+    std::FILE* file_ = nullptr;
+    std::string buffer_;
+    std::atomic<bool> enabled_{false};
+    std::chrono::steady_clock::time_point start_;
+};
+
+#define PCG_TRACE(name, ...)                                                   \
+    do {                                                                       \
+        if (PCG_MAX_LOG_LEVEL > 0 && TraceSink::instance().enabled()) {        \
+            TraceSink::instance().write(name, {__VA_ARGS__});                  \
+        }                                                                      \
+    } while (0)
+
+// ---------------------------------------------------------------------------
+// Perfilado por etapas
+// PCG_PROFILE_SCOPE("nombre") mide el tiempo de un bloque y
+// PCG_PROFILE_COUNT(Contador, n) suma n a uno de los contadores fijos (celdas
+// procesadas, números aleatorios, habitaciones, choques con el borde). Cada hilo
+// acumula en su propio bloque, sin locks ni operaciones atómicas de
+// lectura-modificación-escritura, y Profiler::report() suma todos los bloques.
+// - En compilación: con -DPCG_PROFILE=0 las macros no generan código.
+// - En ejecución: apagado por defecto; entonces cada punto cuesta una lectura.
+// Con recordEvents(true) además se guarda cada ámbito como evento, para
+// exportar un trace de Chrome (chrome://tracing o Perfetto).
+// ---------------------------------------------------------------------------
+#ifndef PCG_PROFILE
+#define PCG_PROFILE 1
+#endif
+
+enum class ProfileCounter { CellsProcessed, RngDraws, RoomsGenerated, BoundaryHits, Count };
+
+constexpr int kProfileCounters = static_cast<int>(ProfileCounter::Count);
+
+const char* profileCounterName(ProfileCounter counter) {
+    switch (counter) {
+        case ProfileCounter::CellsProcessed: return "cells_processed";
+        case ProfileCounter::RngDraws: return "rng_draws";
+        case ProfileCounter::RoomsGenerated: return "rooms_generated";
+        default: return "boundary_hits";
+    }
+}
+
+struct ProfileZoneStats {
+    const char* name = "";
+    uint64_t calls = 0;
+    uint64_t totalNs = 0;
+    uint64_t maxNs = 0;
+};
+
+struct ProfileEvent {
+    uint32_t zone;
+    uint64_t startNs;
+    uint64_t durationNs;
+};
+
+// Resultado combinado de todos los hilos
+struct ProfileReport {
+    struct ThreadEvents {
+        int thread;
+        std::vector<ProfileEvent> events;
+    };
+
+    int threads = 0;
+    std::array<uint64_t, kProfileCounters> counters{};
+    std::vector<ProfileZoneStats> zones;   // solo las zonas con llamadas
+    std::vector<ThreadEvents> events;      // vacío si no se registraron eventos
+    std::vector<const char*> zoneNames;    // nombre de cada índice de zona
+    uint64_t droppedEvents = 0;
+
+    uint64_t counter(ProfileCounter c) const { return counters[static_cast<int>(c)]; }
+
+    const ProfileZoneStats* zone(const char* name) const {
+        for (const ProfileZoneStats& z : zones) {
+            if (std::strcmp(z.name, name) == 0) return &z;
+        }
+        return nullptr;
+    }
+
+    // {"threads": N, "counters": {...}, "zones": [{"name", "calls", "total_ms", "mean_us", "max_us"}, ...]}
+    void writeJson(std::ostream& out) const {
+        char line[256];
+        out << "{\n  \"threads\": " << threads << ",\n  \"dropped_events\": " << droppedEvents
+            << ",\n  \"counters\": {";
+        for (int c = 0; c < kProfileCounters; ++c) {
+            out << (c ? ", " : "") << '"' << profileCounterName(static_cast<ProfileCounter>(c)) << "\": "
+                << counters[c];
+        }
+        out << "},\n  \"zones\": [";
+        for (size_t z = 0; z < zones.size(); ++z) {
+            const ProfileZoneStats& s = zones[z];
+            std::snprintf(line, sizeof(line),
+                          "%s\n    {\"name\": \"%s\", \"calls\": %llu, \"total_ms\": %.4f, \"mean_us\": %.3f, "
+                          "\"max_us\": %.3f}",
+                          z ? "," : "", s.name, static_cast<unsigned long long>(s.calls), s.totalNs * 1e-6,
+                          s.calls ? s.totalNs * 1e-3 / s.calls : 0.0, s.maxNs * 1e-3);
+            out << line;
+        }
+        out << (zones.empty() ? "]\n}\n" : "\n  ]\n}\n");
+    }
+
+    // Formato Trace Event: un evento completo ("X") por ámbito, nombres de los
+    // hilos ("M") y los contadores al final ("C")
+    void writeChromeTrace(std::ostream& out) const {
+        char line[256];
+        uint64_t endNs = 0;
+        out << "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n";
+        bool first = true;
+        for (const ThreadEvents& thread : events) {
+            std::snprintf(line, sizeof(line),
+                          "%s{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": %d, "
+                          "\"args\": {\"name\": \"thread %d\"}}",
+                          first ? "" : ",\n", thread.thread, thread.thread);
+            out << line;
+            first = false;
+            for (const ProfileEvent& e : thread.events) {
+                std::snprintf(line, sizeof(line),
+                              ",\n{\"name\": \"%s\", \"ph\": \"X\", \"pid\": 1, \"tid\": %d, \"ts\": %.3f, \"dur\": %.3f}",
+                              zoneNames[e.zone], thread.thread, e.startNs * 1e-3, e.durationNs * 1e-3);
+                out << line;
+                endNs = std::max(endNs, e.startNs + e.durationNs);
+            }
+        }
+        out << (first ? "" : ",\n") << "{\"name\": \"counters\", \"ph\": \"C\", \"pid\": 1, \"tid\": 0, \"ts\": "
+            << endNs * 1e-3 << ", \"args\": {";
+        for (int c = 0; c < kProfileCounters; ++c) {
+            out << (c ? ", " : "") << '"' << profileCounterName(static_cast<ProfileCounter>(c)) << "\": "
+                << counters[c];
+        }
+        out << "}}\n]}\n";
+    }
+};
+
+class Profiler {
+public:
+    static constexpr int kMaxZones = 64;
+    static constexpr size_t kMaxEventsPerThread = size_t(1) << 20;
+
+    static Profiler& instance() {
+        static Profiler profiler;
+        return profiler;
+    }
+
+    // Estáticos para que la comprobación en cada punto no pase por instance()
+    static void enable(bool on) { enabled_.store(on, std::memory_order_relaxed); }
+    static bool enabled() { return enabled_.load(std::memory_order_relaxed); }
+
+    static void recordEvents(bool on) { recording_.store(on, std::memory_order_relaxed); }
+    static bool recordingEvents() { return recording_.load(std::memory_order_relaxed); }
+
+    // Índice de una zona por nombre; cada punto de medición lo pide una sola vez
+    uint32_t registerZone(const char* name) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (int z = 0; z < zoneCount_; ++z) {
+            if (std::strcmp(zoneNames_[z], name) == 0) return static_cast<uint32_t>(z);
+        }
+        if (zoneCount_ == kMaxZones) return kMaxZones - 1;  // se agrupan en la última
+        zoneNames_[zoneCount_] = name;
+        return static_cast<uint32_t>(zoneCount_++);
+    }
+
+    uint64_t nowNs() const {
+        return static_cast<uint64_t>(
+            std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start_).count());
+    }
+
+    void add(ProfileCounter counter, uint64_t n) { bump(threadData().counters[static_cast<int>(counter)], n); }
+
+    void addZone(uint32_t zone, uint64_t startNs, uint64_t durationNs) {
+        ThreadData& data = threadData();
+        ZoneSlot& slot = data.zones[zone];
+        bump(slot.calls, 1);
+        bump(slot.totalNs, durationNs);
+        if (durationNs > slot.maxNs.load(std::memory_order_relaxed)) {
+            slot.maxNs.store(durationNs, std::memory_order_relaxed);
+        }
+        if (recordingEvents()) {
+            if (data.events.size() < kMaxEventsPerThread) data.events.push_back({zone, startNs, durationNs});
+            else bump(data.dropped, 1);
+        }
+    }
+
+    // report() y reset() leen los bloques de todos los hilos: llamarlos con el
+    // trabajo terminado (por ejemplo, después de parallelFor)
+    ProfileReport report() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        ProfileReport report;
+        report.threads = static_cast<int>(threads_.size());
+        report.zoneNames.assign(zoneNames_.begin(), zoneNames_.begin() + zoneCount_);
+        std::vector<ProfileZoneStats> zones(zoneCount_);
+        for (const auto& data : threads_) {
+            for (int c = 0; c < kProfileCounters; ++c) {
+                report.counters[c] += data->counters[c].load(std::memory_order_relaxed);
+            }
+            for (int z = 0; z < zoneCount_; ++z) {
+                const ZoneSlot& slot = data->zones[z];
+                zones[z].calls += slot.calls.load(std::memory_order_relaxed);
+                zones[z].totalNs += slot.totalNs.load(std::memory_order_relaxed);
+                zones[z].maxNs = std::max(zones[z].maxNs, slot.maxNs.load(std::memory_order_relaxed));
+            }
+            report.droppedEvents += data->dropped.load(std::memory_order_relaxed);
+            if (!data->events.empty()) report.events.push_back({data->thread, data->events});
+        }
+        for (int z = 0; z < zoneCount_; ++z) {
+            zones[z].name = zoneNames_[z];
+            if (zones[z].calls > 0) report.zones.push_back(zones[z]);
+        }
+        return report;
+    }
+
+    void reset() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (auto& data : threads_) {
+            for (auto& counter : data->counters) counter.store(0, std::memory_order_relaxed);
+            for (ZoneSlot& slot : data->zones) {
+                slot.calls.store(0, std::memory_order_relaxed);
+                slot.totalNs.store(0, std::memory_order_relaxed);
+                slot.maxNs.store(0, std::memory_order_relaxed);
+            }
+            data->dropped.store(0, std::memory_order_relaxed);
+            data->events.clear();
+        }
+    }
+
+private:
+    // Un solo hilo escribe cada valor: carga y guardado relajados, sin lock en el bus
+    static void bump(std::atomic<uint64_t>& value, uint64_t n) {
+        value.store(value.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+    }
+
+    struct ZoneSlot {
+        std::atomic<uint64_t> calls{0};
+        std::atomic<uint64_t> totalNs{0};
+        std::atomic<uint64_t> maxNs{0};
+    };
+
+    struct ThreadData {
+        int thread = 0;
+        std::array<std::atomic<uint64_t>, kProfileCounters> counters{};
+        std::array<ZoneSlot, kMaxZones> zones;
+        std::atomic<uint64_t> dropped{0};
+        std::vector<ProfileEvent> events;
+    };
+
+    Profiler() : start_(std::chrono::steady_clock::now()) {}
+
+    // El bloque de cada hilo vive en el Profiler, así que sobrevive al hilo
+    ThreadData& threadData() {
+        thread_local ThreadData* data = nullptr;
+        if (!data) {
+            std::lock_guard<std::mutex> lock(mutex_);
+            threads_.push_back(std::make_unique<ThreadData>());
+            data = threads_.back().get();
+            data->thread = static_cast<int>(threads_.size()) - 1;
+        }
+        return *data;
+    }
+
+    static inline std::atomic<bool> enabled_{false};
+    static inline std::atomic<bool> recording_{false};
+    mutable std::mutex mutex_;
+    std::array<const char*, kMaxZones> zoneNames_{};
+    int zoneCount_ = 0;
+    std::vector<std::unique_ptr<ThreadData>> threads_;
+    std::chrono::steady_clock::time_point start_;
+};
+
+// Mide un ámbito si el perfilado está encendido al entrar
+class ProfileScope {
+public:
+    explicit ProfileScope(uint32_t zone) : zone_(zone), active_(Profiler::enabled()) {
+        if (active_) start_ = Profiler::instance().nowNs();
+    }
+
+    ~ProfileScope() {
+        if (active_) Profiler::instance().addZone(zone_, start_, Profiler::instance().nowNs() - start_);
+    }
+
+    ProfileScope(const ProfileScope&) = delete;
+    ProfileScope& operator=(const ProfileScope&) = delete;
+
+private:
+    uint32_t zone_;
+    bool active_;
+    uint64_t start_ = 0;
+};
+
+#define PCG_PROFILE_CONCAT_(a, b) a##b
+#define PCG_PROFILE_CONCAT(a, b) PCG_PROFILE_CONCAT_(a, b)
+
+#if PCG_PROFILE
+#define PCG_PROFILE_SCOPE(name)                                                                        \
+    static const uint32_t PCG_PROFILE_CONCAT(pcgProfileZone_, __LINE__) =                              \
+        Profiler::instance().registerZone(name);                                                       \
+    ProfileScope PCG_PROFILE_CONCAT(pcgProfileScope_, __LINE__)(PCG_PROFILE_CONCAT(pcgProfileZone_, __LINE__))
+#define PCG_PROFILE_COUNT(counter, n)                                                                  \
+    do {                                                                                               \
+        if (Profiler::enabled()) {                                                                     \
+            Profiler::instance().add(ProfileCounter::counter, static_cast<uint64_t>(n));              \
+        }                                                                                              \
+    } while (0)
+#else
+#define PCG_PROFILE_SCOPE(name) static_assert(true, "")
+#define PCG_PROFILE_COUNT(counter, n) do {} while (0)
+#endif
+
+// ---------------------------------------------------------------------------
+// Detección de SIMD en tiempo de ejecución
+// Los kernels vectoriales se compilan con atributos target("avx2") /
+// target("avx512f") y se eligen al ejecutar, con respaldo escalar.
+// ---------------------------------------------------------------------------
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define PCG_X86_DISPATCH 1
+#endif
+
+enum class SimdLevel { Scalar, AVX2, AVX512 };
+
+const char* simdLevelName(SimdLevel level) {
+    switch (level) {
+        case SimdLevel::AVX512: return "AVX-512";
+        case SimdLevel::AVX2: return "AVX2";
+        default: return "scalar";
+    }
+}
+
+// Mejor nivel SIMD disponible en la CPU actual (se detecta una sola vez)
+SimdLevel detectSimdLevel() {
+#ifdef PCG_X86_DISPATCH
+    static const SimdLevel level = [] {
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx512f")) return SimdLevel::AVX512;
+        if (__builtin_cpu_supports("avx2")) return SimdLevel::AVX2;
+        return SimdLevel::Scalar;
+    }();
+    return level;
+#else
+    return SimdLevel::Scalar;
+#endif
+}
+
+// ---------------------------------------------------------------------------
+// Pool de hilos persistente
+// Los hilos se crean una sola vez y esperan trabajo. parallelFor reparte los
+// índices [0, count) dinámicamente con un contador atómico; el hilo que llama
+// también trabaja (como worker 0). La tarea se guarda como puntero a función +
+// contexto, sin std::function, para no reservar memoria en cada llamada.
+// Varios hilos pueden llamar a parallelFor a la vez (se atienden por turno),
+// pero no es reentrante: no llamarlo desde dentro de una tarea del mismo pool.
+// ---------------------------------------------------------------------------
+class ThreadPool {
+public:
+    explicit ThreadPool(int threads = hardwareThreads()) {
+        threads = std::max(1, threads);
+        for (int t = 1; t < threads; ++t) {
+            workers_.emplace_back([this, t] { workerLoop(t); });
+        }
+    }
+
+    ~ThreadPool() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stop_ = true;
+        }
+        wake_.notify_all();
+        for (auto& worker : workers_) worker.join();
+    }
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    static int hardwareThreads() {
+        return std::max(1u, std::thread::hardware_concurrency());
+    }
+
+    // Número de hilos que ejecutan tareas (incluye al que llama)
+    int size() const { return static_cast<int>(workers_.size()) + 1; }
+
+    // Ejecuta fn(task, worker) para cada task en [0, count) y espera a que terminen todas.
+    // worker está en [0, size()) y sirve para indexar memoria auxiliar por hilo
+    template <class Fn>
+    void parallelFor(int count, Fn&& fn) {
+        if (count <= 0) return;
+        if (workers_.empty() || count == 1) {
+            for (int task = 0; task < count; ++task) fn(task, 0);
+            return;
+        }
+        std::lock_guard<std::mutex> turn(submit_);
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            invoke_ = [](void* context, int task, int worker) {
+                (*static_cast<std::remove_reference_t<Fn>*>(context))(task, worker);
+            };
+            context_ = &fn;
+            taskCount_ = count;
+            nextTask_.store(0, std::memory_order_relaxed);
+            busy_ = static_cast<int>(workers_.size());
+            ++generation_;
+        }
+        wake_.notify_all();
+        runTasks(0);
+        std::unique_lock<std::mutex> lock(mutex_);
+        done_.wait(lock, [this] { return busy_ == 0; });
+    }
+
+private:
+    void workerLoop(int worker) {
+        uint64_t seen = 0;
+        for (;;) {
+            {
+                std::unique_lock<std::mutex> lock(mutex_);
+                wake_.wait(lock, [&] { return stop_ || generation_ != seen; });
+                if (stop_) return;
+                seen = generation_;
+            }
+            runTasks(worker);
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                if (--busy_ == 0) done_.notify_one();
+            }
+        }
+    }
+
+    void runTasks(int worker) {
+        for (;;) {
+            int task = nextTask_.fetch_add(1, std::memory_order_relaxed);
+            if (task >= taskCount_) return;
+            invoke_(context_, task, worker);
+        }
+    }
+
+    std::vector<std::thread> workers_;
+    std::mutex submit_;
+    std::mutex mutex_;
+    std::condition_variable wake_;
+    std::condition_variable done_;
+    uint64_t generation_ = 0;
+    bool stop_ = false;
+    int busy_ = 0;
+    int taskCount_ = 0;
+    std::atomic<int> nextTask_{0};
+    void (*invoke_)(void*, int, int) = nullptr;
+    void* context_ = nullptr;
+};
+
+// Pool compartido por todo el programa, con un hilo por núcleo
+ThreadPool& defaultThreadPool() {
+    static ThreadPool pool;
+    return pool;
+}
+
+// Pool sin hilos: parallelFor se ejecuta en el hilo que llama. Sirve para usar
+// los motores paralelos dentro de tareas que ya corren en otro pool
+ThreadPool& inlineThreadPool() {
+    static ThreadPool pool(1);
+    return pool;
+}
+
+// ---------------------------------------------------------------------------
+// Generador aleatorio basado en contador (Philox4x32-10)
+// Cada bloque de 4 x 32 bits es una función pura de (clave, contador), de modo
+// que cualquier posición de la secuencia se puede calcular directamente. La
+// clave se deriva de (semilla, etapa) y el contador de 128 bits lleva el número
+// de flujo (fila, baldosa, agente...) en la mitad alta y la posición en la baja.
+// Así el resultado depende solo de la semilla y no del orden de ejecución ni
+// del número de hilos, y un mapa se puede regenerar a partir de su semilla.
+// ---------------------------------------------------------------------------
+
+// Etapas del pipeline; forman parte de la clave del generador
+enum class RngStage : uint32_t {
+    Noise = 1,
+    DrunkAgent = 2,
+    EnhancedDrunkAgent = 3,
+    Search = 4,
+    States = 5,
+};
+
+// Mezclador de 64 bits (SplitMix64)
+inline uint64_t mixBits(uint64_t x) {
+    x += 0x9E3779B97F4A7C15ull;
+    x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ull;
+    x = (x ^ (x >> 27)) * 0x94D049BB133111EBull;
+    return x ^ (x >> 31);
+}
+
+// Semilla derivada para la llamada/índice n de una semilla base
+inline uint64_t deriveSeed(uint64_t seed, uint64_t n) {
+    return mixBits(seed ^ mixBits(n + 0x632BE59BD9B4E019ull));
+}
+
+// Semilla no reproducible, para cuando el usuario no indica una
+inline uint64_t randomSeed() {
+    static std::atomic<uint64_t> calls{0};
+    uint64_t now = static_cast<uint64_t>(std::chrono::steady_clock::now().time_since_epoch().count());
+    return mixBits(now ^ mixBits(calls.fetch_add(1, std::memory_order_relaxed)));
+}
+
+class CounterRng {
+public:
+    using Block = std::array<uint32_t, 4>;
+
+    CounterRng(uint64_t seed, RngStage stage, uint64_t stream, uint64_t position = 0)
+        : stream_(stream), start_(position), position_(position) {
+        uint64_t key = mixBits(seed ^ (static_cast<uint64_t>(stage) << 56));
+        key_[0] = static_cast<uint32_t>(key);
+        key_[1] = static_cast<uint32_t>(key >> 32);
+    }
+
+    // Bloque número `position` del flujo `stream` (acceso aleatorio)
+    static Block philox(const std::array<uint32_t, 2>& key, uint64_t stream, uint64_t position) {
+        Block ctr = {static_cast<uint32_t>(position), static_cast<uint32_t>(position >> 32),
+                     static_cast<uint32_t>(stream), static_cast<uint32_t>(stream >> 32)};
+        uint32_t k0 = key[0];
+        uint32_t k1 = key[1];
+        for (int round = 0; round < 10; ++round) {
+            uint64_t p0 = static_cast<uint64_t>(0xD2511F53u) * ctr[0];
+            uint64_t p1 = static_cast<uint64_t>(0xCD9E8D57u) * ctr[2];
+            ctr = {static_cast<uint32_t>(p1 >> 32) ^ ctr[1] ^ k0, static_cast<uint32_t>(p1),
+                   static_cast<uint32_t>(p0 >> 32) ^ ctr[3] ^ k1, static_cast<uint32_t>(p0)};
+            k0 += 0x9E3779B9u;
+            k1 += 0xBB67AE85u;
+        }
+        return ctr;
+    }
+
+    Block block(uint64_t position) const { return philox(key_, stream_, position); }
+
+    const std::array<uint32_t, 2>& key() const { return key_; }
+    uint64_t stream() const { return stream_; }
+
+    uint32_t nextU32() {
+        if (lane_ == 4) {
+            buffer_ = block(position_++);
+            lane_ = 0;
+        }
+        return buffer_[lane_++];
+    }
+
+    uint64_t nextU64() {
+        uint64_t lo = nextU32();
+        return lo | (static_cast<uint64_t>(nextU32()) << 32);
+    }
+
+    // Real uniforme en [0, 1) con 53 bits de precisión
+    double nextDouble() {
+        return static_cast<double>(nextU64() >> 11) * (1.0 / 9007199254740992.0);
+    }
+
+    // Entero uniforme en [0, n), sin sesgo (método de Lemire)
+    int nextInt(int n) {
+        uint32_t range = static_cast<uint32_t>(n);
+        uint64_t m = static_cast<uint64_t>(nextU32()) * range;
+        uint32_t low = static_cast<uint32_t>(m);
+        if (low < range) {
+            uint32_t threshold = static_cast<uint32_t>(-range) % range;
+            while (low < threshold) {
+                m = static_cast<uint64_t>(nextU32()) * range;
+                low = static_cast<uint32_t>(m);
+            }
+        }
+        return static_cast<int>(m >> 32);
+    }
+
+    // Cantidad de valores de 32 bits consumidos hasta ahora por este generador
+    // (desde la posición con que se creó, no desde el principio del flujo)
+    uint64_t drawn() const { return (position_ - start_) * 4 - (4 - lane_); }
+
+private:
+    std::array<uint32_t, 2> key_;
+    uint64_t stream_;
+    uint64_t start_;
+    uint64_t position_;
+    Block buffer_{};
+    int lane_ = 4;
+};
+
+// ---------------------------------------------------------------------------
+// Renderizado de mapas
+// Cada fila se arma en un buffer de bytes reutilizable y el cuadro completo se
+// escribe con un solo fwrite. Las celdas se procesan de a 8 (un byte de la fila
+// empaquetada): una tabla de 256 entradas da directamente los 16 caracteres
+// ("# " o ". " por celda), y otra invierte el orden de los bits para PBM, que
+// guarda la columna 0 en el bit más significativo. Se escribe 1 = '#' = negro.
+// ---------------------------------------------------------------------------
+enum class ImageFormat { PBM, PGM };
+
+inline const std::array<std::array<char, 16>, 256>& asciiByteTable() {
+    static const auto table = [] {
+        std::array<std::array<char, 16>, 256> t{};
+        for (int byte = 0; byte < 256; ++byte) {
+            for (int b = 0; b < 8; ++b) {
+                t[byte][2 * b] = ((byte >> b) & 1) ? '#' : '.';
+                t[byte][2 * b + 1] = ' ';
+            }
+        }
+        return t;
+    }();
+    return table;
+}
+
+inline const std::array<uint8_t, 256>& reversedBitsTable() {
+    static const auto table = [] {
+        std::array<uint8_t, 256> t{};
+        for (int byte = 0; byte < 256; ++byte) {
+            for (int b = 0; b < 8; ++b) t[byte] |= static_cast<uint8_t>(((byte >> b) & 1) << (7 - b));
+        }
+        return t;
+    }();
+    return table;
+}
+
+// Celdas [8k, 8k + 8) de la fila i como un byte (bit b = columna 8k + b); las
+// columnas fuera del mapa valen 0
+inline uint8_t cellByte(const Grid& grid, int i, int k) {
+    if (grid.packed()) return grid.rowBytes(i)[k];
+    const uint8_t* row = grid.rowBytes(i);
+    const int count = std::min(8, grid.width() - 8 * k);
+    uint8_t byte = 0;
+    for (int b = 0; b < count; ++b) byte |= static_cast<uint8_t>(row[8 * k + b] << b);
+    return byte;
+}
+
+constexpr char kMapHeader[] = "--- Current Map ---\n";
+constexpr char kMapFooter[] = "-------------------\n";
+
+// Cuadro ASCII completo (con encabezado y pie, como printMap) en out
+void renderAscii(const Grid& grid, std::vector<char>& out) {
+    const int W = grid.width();
+    const size_t rowChars = 2 * static_cast<size_t>(W) + 1;
+    const size_t header = sizeof(kMapHeader) - 1;
+    const size_t footer = sizeof(kMapFooter) - 1;
+    out.resize(header + rowChars * grid.height() + footer);
+    char* p = out.data();
+    std::memcpy(p, kMapHeader, header);
+    p += header;
+    const auto& table = asciiByteTable();
+    const int fullBytes = W / 8;
+    for (int i = 0; i < grid.height(); ++i) {
+        for (int k = 0; k < fullBytes; ++k, p += 16) std::memcpy(p, table[cellByte(grid, i, k)].data(), 16);
+        if (W & 7) {
+            const size_t tail = 2 * static_cast<size_t>(W & 7);
+            std::memcpy(p, table[cellByte(grid, i, fullBytes)].data(), tail);
+            p += tail;
+        }
+        *p++ = '\n';
+    }
+    std::memcpy(p, kMapFooter, footer);
+}
+
+void renderAscii(const Map& map, std::vector<char>& out) {
+    size_t cells = 0;
+    for (const auto& row : map) cells += row.size();
+    const size_t header = sizeof(kMapHeader) - 1;
+    const size_t footer = sizeof(kMapFooter) - 1;
+    out.resize(header + 2 * cells + map.size() + footer);
+    char* p = out.data();
+    std::memcpy(p, kMapHeader, header);
+    p += header;
     for (const auto& row : map) {
         for (int cell : row) {
-            if (cell == 0) {
-                std::cout << ". ";  // Espacios vacíos
-            } else {
-                std::cout << "# ";  // Pasillos y habitaciones
+            *p++ = cell == 0 ? '.' : '#';
+            *p++ = ' ';
+        }
+        *p++ = '\n';
+    }
+    std::memcpy(p, kMapFooter, footer);
+}
+
+// Imagen binaria: PBM (P4, 1 bit por celda) o PGM (P5, 0 = blanco, 1 = negro)
+void renderImage(const Grid& grid, ImageFormat format, std::vector<char>& out) {
+    const int W = grid.width();
+    const std::string header = std::string(format == ImageFormat::PBM ? "P4\n" : "P5\n") + std::to_string(W) +
+                               " " + std::to_string(grid.height()) + (format == ImageFormat::PBM ? "\n" : "\n255\n");
+    const size_t rowBytes = format == ImageFormat::PBM ? (static_cast<size_t>(W) + 7) / 8 : W;
+    out.resize(header.size() + rowBytes * grid.height());
+    char* p = out.data();
+    std::memcpy(p, header.data(), header.size());
+    p += header.size();
+    const auto& reversed = reversedBitsTable();
+    for (int i = 0; i < grid.height(); ++i) {
+        if (format == ImageFormat::PBM) {
+            for (size_t k = 0; k < rowBytes; ++k) *p++ = static_cast<char>(reversed[cellByte(grid, i, static_cast<int>(k))]);
+        } else {
+            for (int j = 0; j < W; j += 8) {
+                const uint8_t byte = cellByte(grid, i, j >> 3);
+                for (int b = 0; b < std::min(8, W - j); ++b) *p++ = static_cast<char>(((byte >> b) & 1) - 1);
             }
         }
-        std::cout << std::endl;
     }
-    std::cout << "-------------------" << std::endl;
 }
 
-// Función para inicializar el mapa con ruido aleatorio
-Map initializeWithNoise(int W, int H, double density = 0.45) {
-    Map map(H, std::vector<int>(W, 0));
-    std::mt19937 rng(std::chrono::steady_clock::now().time_since_epoch().count());
-    std::uniform_real_distribution<double> chance(0.0, 1.0);
+inline bool writeFrame(std::FILE* file, const std::vector<char>& frame) {
+    return std::fwrite(frame.data(), 1, frame.size(), file) == frame.size();
+}
+
+bool writeImage(const std::string& path, const Grid& grid, ImageFormat format) {
+    std::vector<char> frame;
+    renderImage(grid, format, frame);
+    std::FILE* file = std::fopen(path.c_str(), "wb");
+    if (!file) return false;
+    const bool ok = writeFrame(file, frame);
+    return std::fclose(file) == 0 && ok;
+}
+
+// Buffer reutilizado entre llamadas a printMap en el mismo hilo
+inline std::vector<char>& printBuffer() {
+    static thread_local std::vector<char> buffer;
+    return buffer;
+}
+
+// std::cout está sincronizado con stdio, así que el cuadro queda en orden con
+// lo ya escrito por std::cout
+void printMap(const Grid& grid) {
+    std::vector<char>& buffer = printBuffer();
+    renderAscii(grid, buffer);
+    writeFrame(stdout, buffer);
+    std::fflush(stdout);
+}
+
+void printMap(const Map& map) {
+    std::vector<char>& buffer = printBuffer();
+    renderAscii(map, buffer);
+    writeFrame(stdout, buffer);
+    std::fflush(stdout);
+}
+
+// ---------------------------------------------------------------------------
+// Ruido inicial rápido
+// En vez de un double por celda, cada valor de 32 bits de Philox se compara
+// con un umbral entero precalculado (densidad * 2^32): un bloque da 4 celdas y
+// 16 bloques llenan directamente una palabra empaquetada de 64 celdas. La
+// celda (i, j) usa el valor j % 4 del bloque j / 4 del flujo (seed, Noise, i),
+// así que cualquier fila o tramo de columnas se puede generar por separado y
+// el resultado no depende del reparto entre hilos ni del almacenamiento.
+// ---------------------------------------------------------------------------
+
+// Umbral de 32 bits equivalente a la densidad (2^32 = siempre 1)
+inline uint64_t noiseThreshold(double density) {
+    if (!(density > 0.0)) return 0;
+    if (density >= 1.0) return uint64_t(1) << 32;
+    return static_cast<uint64_t>(density * 4294967296.0);
+}
+
+// Palabras [firstWord, firstWord + count) de ruido empaquetado de un flujo.
+// Philox se evalúa sobre 16 contadores a la vez en forma SoA para que el
+// compilador lo vectorice
+__attribute__((always_inline)) inline void noiseWordsImpl(const std::array<uint32_t, 2>& key, uint64_t stream,
+                                                          size_t firstWord, size_t count, uint64_t threshold,
+                                                          uint64_t* out) {
+    constexpr int blocks = 16;
+    const uint32_t streamLo = static_cast<uint32_t>(stream);
+    const uint32_t streamHi = static_cast<uint32_t>(stream >> 32);
+    for (size_t w = 0; w < count; ++w) {
+        const uint64_t position = (firstWord + w) * blocks;
+        uint32_t c0[blocks], c1[blocks], c2[blocks], c3[blocks];
+        for (int l = 0; l < blocks; ++l) {
+            c0[l] = static_cast<uint32_t>(position + l);
+            c1[l] = static_cast<uint32_t>((position + l) >> 32);
+            c2[l] = streamLo;
+            c3[l] = streamHi;
+        }
+        uint32_t k0 = key[0];
+        uint32_t k1 = key[1];
+        for (int round = 0; round < 10; ++round) {
+            for (int l = 0; l < blocks; ++l) {
+                uint64_t p0 = static_cast<uint64_t>(0xD2511F53u) * c0[l];
+                uint64_t p1 = static_cast<uint64_t>(0xCD9E8D57u) * c2[l];
+                uint32_t n0 = static_cast<uint32_t>(p1 >> 32) ^ c1[l] ^ k0;
+                uint32_t n2 = static_cast<uint32_t>(p0 >> 32) ^ c3[l] ^ k1;
+                c1[l] = static_cast<uint32_t>(p1);
+                c3[l] = static_cast<uint32_t>(p0);
+                c0[l] = n0;
+                c2[l] = n2;
+            }
+            k0 += 0x9E3779B9u;
+            k1 += 0xBB67AE85u;
+        }
+        uint64_t bits = 0;
+        for (int l = 0; l < blocks; ++l) {
+            bits |= static_cast<uint64_t>(c0[l] < threshold) << (4 * l);
+            bits |= static_cast<uint64_t>(c1[l] < threshold) << (4 * l + 1);
+            bits |= static_cast<uint64_t>(c2[l] < threshold) << (4 * l + 2);
+            bits |= static_cast<uint64_t>(c3[l] < threshold) << (4 * l + 3);
+        }
+        out[w] = bits;
+    }
+}
+
+void noiseWordsScalar(const std::array<uint32_t, 2>& key, uint64_t stream, size_t firstWord,
+                      size_t count, uint64_t threshold, uint64_t* out) {
+    noiseWordsImpl(key, stream, firstWord, count, threshold, out);
+}
+
+#ifdef PCG_X86_DISPATCH
+__attribute__((target("avx2")))
+void noiseWordsAVX2(const std::array<uint32_t, 2>& key, uint64_t stream, size_t firstWord,
+                    size_t count, uint64_t threshold, uint64_t* out) {
+    noiseWordsImpl(key, stream, firstWord, count, threshold, out);
+}
+
+__attribute__((target("avx512f")))
+void noiseWordsAVX512(const std::array<uint32_t, 2>& key, uint64_t stream, size_t firstWord,
+                      size_t count, uint64_t threshold, uint64_t* out) {
+    noiseWordsImpl(key, stream, firstWord, count, threshold, out);
+}
+#endif
+
+using NoiseWordsFn = void (*)(const std::array<uint32_t, 2>&, uint64_t, size_t, size_t, uint64_t, uint64_t*);
+
+NoiseWordsFn noiseWordsFunction(SimdLevel level = detectSimdLevel()) {
+#ifdef PCG_X86_DISPATCH
+    if (level == SimdLevel::AVX512) return noiseWordsAVX512;
+    if (level == SimdLevel::AVX2) return noiseWordsAVX2;
+#else
+    (void)level;
+#endif
+    return noiseWordsScalar;
+}
+
+// Llena las filas [rowBegin, rowEnd) con ruido; rowBuffer solo se usa con almacenamiento Bytes.
+// Con rowOffset/colOffset la grilla es una ventana del mapa completo que empieza
+// en esa celda (colOffset múltiplo de 64) y recibe exactamente el mismo ruido
+void fillNoiseRows(Grid& grid, uint64_t seed, uint64_t threshold, int rowBegin, int rowEnd,
+                   std::vector<uint64_t>& rowBuffer, int64_t rowOffset = 0, int64_t colOffset = 0) {
+    const int W = grid.width();
+    const size_t words = (static_cast<size_t>(W) + 63) / 64;
+    if (words == 0) return;
+    PCG_PROFILE_SCOPE("noise_rows");
+    // Un valor de 32 bits por celda, incluido el relleno de la última palabra
+    PCG_PROFILE_COUNT(CellsProcessed, static_cast<uint64_t>(rowEnd - rowBegin) * W);
+    PCG_PROFILE_COUNT(RngDraws, static_cast<uint64_t>(rowEnd - rowBegin) * words * 64);
+    const size_t firstWord = static_cast<size_t>(colOffset) / 64;
+    NoiseWordsFn noiseWords = noiseWordsFunction();
+    for (int i = rowBegin; i < rowEnd; ++i) {
+        CounterRng rng(seed, RngStage::Noise, static_cast<uint64_t>(rowOffset + i));
+        if (grid.packed()) {
+            uint64_t* row = grid.rowWords(i);
+            noiseWords(rng.key(), rng.stream(), firstWord, words, threshold, row);
+            row[words - 1] &= lastWordMask(W);
+        } else {
+            rowBuffer.resize(words);
+            noiseWords(rng.key(), rng.stream(), firstWord, words, threshold, rowBuffer.data());
+            uint8_t* row = grid.rowBytes(i);
+            for (int j = 0; j < W; ++j) {
+                row[j] = static_cast<uint8_t>((rowBuffer[j >> 6] >> (j & 63)) & 1);
+            }
+        }
+    }
+}
+
+// Función para inicializar la grilla con ruido aleatorio.
+// Las filas se reparten en bloques entre los hilos del pool (pool = nullptr
+// para hacerlo en el hilo actual); el mapa depende solo de la semilla
+void initializeWithNoise(Grid& grid, double density = 0.45, uint64_t seed = randomSeed(),
+                         ThreadPool* pool = &defaultThreadPool()) {
+    PCG_LOG(Summary, "Initializing map with random noise (density: " << density << ")");
+    PCG_PROFILE_SCOPE("noise");
+
+    const uint64_t threshold = noiseThreshold(density);
+    const int rowsPerTask = 64;
+    const int tasks = (grid.height() + rowsPerTask - 1) / rowsPerTask;
+    auto fillTask = [&](int task, int) {
+        std::vector<uint64_t> rowBuffer;
+        int rowBegin = task * rowsPerTask;
+        fillNoiseRows(grid, seed, threshold, rowBegin, std::min(grid.height(), rowBegin + rowsPerTask), rowBuffer);
+    };
+    if (pool) {
+        pool->parallelFor(tasks, fillTask);
+    } else {
+        for (int task = 0; task < tasks; ++task) fillTask(task, 0);
+    }
+}
+
+// Función para inicializar el mapa con ruido aleatorio
+Map initializeWithNoise(int W, int H, double density = 0.45, uint64_t seed = randomSeed()) {
+    Grid grid(W, H);
+    initializeWithNoise(grid, density, seed);
+    return grid.toMap();
+}
+
+// Cuenta los vecinos de (i, j) en un radio cuadrado R; los bordes cuentan como 1 (muros)
+template <Grid::Storage S>
+inline int countNeighborsDirect(const Grid& grid, int i, int j, int R) {
+    const int W = grid.width();
+    const int H = grid.height();
+    int neighbors = 0;
+    for (int di = -R; di <= R; ++di) {
+        for (int dj = -R; dj <= R; ++dj) {
+            if (di == 0 && dj == 0) continue; // No contar la celda central
+
+            int ni = i + di;
+            int nj = j + dj;
+
+            if (ni < 0 || ni >= H || nj < 0 || nj >= W) {
+                neighbors++;
+            } else {
+                neighbors += readCell<S>(grid, ni, nj);
+            }
+        }
+    }
+    return neighbors;
+}
+
+// Modo de conteo de vecinos del autómata celular:
+// - Direct: recorre el vecindario (2R+1)^2 completo en cada celda
+// - BoxSum: sumas de caja separables (suma deslizante por columnas + ventana
+//   horizontal), costo O(1) por celda sin importar R
+// - Bitboard: solo R = 1 sobre almacenamiento Bits; cuenta los 8 vecinos de
+//   64 celdas por palabra (o 256/512 con AVX2/AVX-512) con sumadores bit a bit
+// - Specialized: kernel con R y U fijos en compilación (R = 1..3, reglas
+//   habituales, almacenamiento Bits); ver findRuleKernel
+// - Auto:   Specialized si hay kernel para (R, U); si no, Bitboard si es
+//   aplicable, BoxSum para R >= 2 y Direct en otro caso
+// Todos los modos producen exactamente el mismo resultado.
+enum class NeighborCounting { Auto, Direct, BoxSum, Bitboard, Specialized };
+
+// Modo genérico para R (los kernels especializados se eligen en caStep)
+inline NeighborCounting resolveCounting(NeighborCounting counting, int R, bool packed) {
+    if (counting == NeighborCounting::Specialized) counting = NeighborCounting::Auto;
+    bool bitboardOk = R == 1 && packed;
+    if (counting == NeighborCounting::Bitboard && !bitboardOk) counting = NeighborCounting::Auto;
+    if (counting != NeighborCounting::Auto) return counting;
+    if (bitboardOk) return NeighborCounting::Bitboard;
+    return R >= 2 ? NeighborCounting::BoxSum : NeighborCounting::Direct;
+}
+
+// Memoria auxiliar reutilizable entre iteraciones del autómata
+struct CAScratch {
+    std::vector<int> colSum;        // sumas por columna, con R columnas de relleno a cada lado
+    std::vector<uint8_t> rowChanges;
+    std::vector<uint64_t> padRows;  // filas empaquetadas con una palabra de muro a cada lado
+    std::vector<uint64_t> outRow;
+    std::vector<uint64_t> planeRows;  // sumas horizontales en planos de bits (kernels especializados)
+
+    // Reserva lo que necesita un paso de radio R sobre filas como las de grid
+    void reserve(const Grid& grid, int R);
+};
+
+// Un paso del autómata celular para las filas [rowBegin, rowEnd):
+// lee siempre de src y escribe en dst (nunca sobreescribe la grilla que se lee)
+template <Grid::Storage S>
+void caStepDirect(const Grid& src, Grid& dst, int R, int U, int rowBegin, int rowEnd) {
+    for (int i = rowBegin; i < rowEnd; ++i) {
+        for (int j = 0; j < src.width(); ++j) {
+            writeCell<S>(dst, i, j, countNeighborsDirect<S>(src, i, j, R) >= U ? 1 : 0);
+        }
+    }
+}
+
+// Suma (sign = +1) o resta (sign = -1) la fila r a las sumas por columna.
+// Las filas fuera del mapa cuentan como muros (1 en cada columna)
+template <Grid::Storage S>
+inline void accumulateRow(const Grid& grid, int r, int sign, int R, std::vector<int>& colSum) {
+    int* col = colSum.data() + R;
+    const int W = grid.width();
+    if (r < 0 || r >= grid.height()) {
+        for (int j = 0; j < W; ++j) col[j] += sign;
+        return;
+    }
+    for (int j = 0; j < W; ++j) {
+        col[j] += sign * readCell<S>(grid, r, j);
+    }
+}
+
+// Prepara las sumas por columna de la ventana vertical centrada en la fila i.
+// Las R columnas de relleno a cada lado valen 2R+1 (muros fuera del mapa)
+template <Grid::Storage S>
+void initColumnWindow(const Grid& grid, int i, int R, std::vector<int>& colSum) {
+    const int W = grid.width();
+    colSum.assign(W + 2 * R, 2 * R + 1);
+    std::fill(colSum.begin() + R, colSum.begin() + R + W, 0);
+    for (int r = i - R; r <= i + R; ++r) {
+        accumulateRow<S>(grid, r, +1, R, colSum);
+    }
+}
+
+// Recorre la fila i con una ventana horizontal de ancho 2R+1 sobre las sumas
+// por columna y entrega (j, vecinos) para cada celda
+template <Grid::Storage S, class Emit>
+inline void boxSumRow(const Grid& grid, int i, int R, const std::vector<int>& colSum, Emit emit) {
+    const int W = grid.width();
+    const int* col = colSum.data();
+    int box = 0;
+    for (int p = 0; p <= 2 * R; ++p) box += col[p];
+    for (int j = 0; j < W; ++j) {
+        emit(j, box - readCell<S>(grid, i, j));
+        if (j + 1 < W) box += col[j + 2 * R + 1] - col[j];
+    }
+}
+
+template <Grid::Storage S>
+void caStepBoxSum(const Grid& src, Grid& dst, int R, int U, int rowBegin, int rowEnd,
+                  std::vector<int>& colSum) {
+    if (rowBegin >= rowEnd) return;
+    initColumnWindow<S>(src, rowBegin, R, colSum);
+    for (int i = rowBegin; i < rowEnd; ++i) {
+        boxSumRow<S>(src, i, R, colSum, [&](int j, int neighbors) {
+            writeCell<S>(dst, i, j, neighbors >= U ? 1 : 0);
+        });
+        if (i + 1 < rowEnd) {
+            accumulateRow<S>(src, i - R, -1, R, colSum);
+            accumulateRow<S>(src, i + R + 1, +1, R, colSum);
+        }
+    }
+}
+
+// ---------------------------------------------------------------------------
+// Kernel bitboard para R = 1
+// Cada palabra contiene 64 celdas. Los 8 vecinos de todas ellas se obtienen
+// desplazando las filas superior, actual e inferior un bit a cada lado, y se
+// suman en planos de bits (1, 2, 4, 8) con sumadores completos. El umbral U se
+// compara también plano a plano, sin ramas por celda. Los muros del borde se
+// modelan con filas de relleno: una palabra de unos a cada lado de la fila y
+// los bits de relleno de la última palabra en 1; las filas fuera del mapa son
+// filas completas de unos.
+// ---------------------------------------------------------------------------
+
+// Macro de carga sin alinear; evita pasar tipos vectoriales por valor entre
+// funciones, lo que cambiaría el ABI fuera de las funciones compiladas para AVX
+#define PCG_LOAD_WORDS(V, var, ptr) V var; std::memcpy(&var, (ptr), sizeof(V))
+
+// Escribe en out la máscara de celdas con (número de vecinos) >= U, para 1 <= U <= 8
+template <class V>
+__attribute__((always_inline)) inline void bitboardRuleWords(const uint64_t* up, const uint64_t* cur,
+                                                             const uint64_t* down, uint64_t* out, int U) {
+    PCG_LOAD_WORDS(V, n, up);
+    PCG_LOAD_WORDS(V, nPrev, up - 1);
+    PCG_LOAD_WORDS(V, nNext, up + 1);
+    PCG_LOAD_WORDS(V, c, cur);
+    PCG_LOAD_WORDS(V, cPrev, cur - 1);
+    PCG_LOAD_WORDS(V, cNext, cur + 1);
+    PCG_LOAD_WORDS(V, s, down);
+    PCG_LOAD_WORDS(V, sPrev, down - 1);
+    PCG_LOAD_WORDS(V, sNext, down + 1);
+
+    // La celda de la columna j-1 queda en el bit de j al desplazar a la izquierda
+    V nw = (n << 1) | (nPrev >> 63);
+    V ne = (n >> 1) | (nNext << 63);
+    V w  = (c << 1) | (cPrev >> 63);
+    V e  = (c >> 1) | (cNext << 63);
+    V sw = (s << 1) | (sPrev >> 63);
+    V se = (s >> 1) | (sNext << 63);
+
+    // Unos: tres sumadores sobre los 8 vecinos
+    V s0 = nw ^ n ^ ne;
+    V c0 = (nw & n) | (ne & (nw ^ n));
+    V s1 = w ^ e ^ sw;
+    V c1 = (w & e) | (sw & (w ^ e));
+    V s2 = s ^ se;
+    V c2 = s & se;
+    V b0 = s0 ^ s1 ^ s2;
+    V k0 = (s0 & s1) | (s2 & (s0 ^ s1));
+    // Doses: c0 + c1 + c2 + k0
+    V t  = c0 ^ c1 ^ c2;
+    V k1 = (c0 & c1) | (c2 & (c0 ^ c1));
+    V b1 = t ^ k0;
+    V k2 = t & k0;
+    // Cuatros y ochos
+    V b2 = k1 ^ k2;
+    V b3 = k1 & k2;
+
+    // Comparación (b3 b2 b1 b0) >= U desde el bit más significativo
+    V planes[4] = {b0, b1, b2, b3};
+    V gt = n ^ n;
+    V eq = ~gt;
+    for (int bit = 3; bit >= 0; --bit) {
+        if ((U >> bit) & 1) {
+            eq &= planes[bit];
+        } else {
+            gt |= eq & planes[bit];
+            eq &= ~planes[bit];
+        }
+    }
+    V result = gt | eq;
+    std::memcpy(out, &result, sizeof(V));
+}
+
+#undef PCG_LOAD_WORDS
+
+// Procesa una fila completa; up/cur/down apuntan a la primera palabra de filas con relleno
+template <class V>
+__attribute__((always_inline)) inline void bitboardRowImpl(const uint64_t* up, const uint64_t* cur,
+                                                           const uint64_t* down, uint64_t* out,
+                                                           size_t words, int U) {
+    constexpr size_t lanes = sizeof(V) / sizeof(uint64_t);
+    size_t w = 0;
+    for (; w + lanes <= words; w += lanes) {
+        bitboardRuleWords<V>(up + w, cur + w, down + w, out + w, U);
+    }
+    for (; w < words; ++w) {
+        bitboardRuleWords<uint64_t>(up + w, cur + w, down + w, out + w, U);
+    }
+}
+
+void bitboardRowScalar(const uint64_t* up, const uint64_t* cur, const uint64_t* down,
+                       uint64_t* out, size_t words, int U) {
+    bitboardRowImpl<uint64_t>(up, cur, down, out, words, U);
+}
+
+#ifdef PCG_X86_DISPATCH
+typedef uint64_t U64x4 __attribute__((vector_size(32)));
+typedef uint64_t U64x8 __attribute__((vector_size(64)));
+
+__attribute__((target("avx2")))
+void bitboardRowAVX2(const uint64_t* up, const uint64_t* cur, const uint64_t* down,
+                     uint64_t* out, size_t words, int U) {
+    bitboardRowImpl<U64x4>(up, cur, down, out, words, U);
+}
+
+__attribute__((target("avx512f")))
+void bitboardRowAVX512(const uint64_t* up, const uint64_t* cur, const uint64_t* down,
+                       uint64_t* out, size_t words, int U) {
+    bitboardRowImpl<U64x8>(up, cur, down, out, words, U);
+}
+#endif
+
+using BitboardRowFn = void (*)(const uint64_t*, const uint64_t*, const uint64_t*, uint64_t*, size_t, int);
+
+BitboardRowFn bitboardRowFunction(SimdLevel level) {
+#ifdef PCG_X86_DISPATCH
+    if (level == SimdLevel::AVX512) return bitboardRowAVX512;
+    if (level == SimdLevel::AVX2) return bitboardRowAVX2;
+#else
+    (void)level;
+#endif
+    return bitboardRowScalar;
+}
+
+// Copia la fila r a un buffer con una palabra de muro a cada lado; fuera del mapa, todo muro
+inline void loadPaddedRow(const Grid& grid, int r, uint64_t* padded) {
+    const size_t stride = grid.strideWords();
+    if (r < 0 || r >= grid.height()) {
+        std::fill(padded, padded + stride + 2, ~uint64_t(0));
+        return;
+    }
+    padded[0] = ~uint64_t(0);
+    std::memcpy(padded + 1, grid.rowWords(r), stride * sizeof(uint64_t));
+    padded[stride] |= ~lastWordMask(grid.width());
+    padded[stride + 1] = ~uint64_t(0);
+}
+
+// Resultado constante cuando U está fuera de [1, 8]
+inline bool bitboardTrivialRow(uint64_t* out, size_t words, int U) {
+    if (U <= 0) { std::fill(out, out + words, ~uint64_t(0)); return true; }
+    if (U > 8)  { std::fill(out, out + words, uint64_t(0));  return true; }
+    return false;
+}
+
+void caStepBitboard(const Grid& src, Grid& dst, int U, int rowBegin, int rowEnd,
+                    CAScratch& scratch, SimdLevel level = detectSimdLevel()) {
+    const size_t stride = src.strideWords();
+    if (stride == 0 || rowBegin >= rowEnd) return;
+    const size_t padStride = stride + 2;
+    const uint64_t mask = lastWordMask(src.width());
+    BitboardRowFn rowFn = bitboardRowFunction(level);
+
+    scratch.padRows.resize(3 * padStride);
+    uint64_t* rows[3] = {scratch.padRows.data(), scratch.padRows.data() + padStride,
+                         scratch.padRows.data() + 2 * padStride};
+    loadPaddedRow(src, rowBegin - 1, rows[0]);
+    loadPaddedRow(src, rowBegin, rows[1]);
+
+    for (int i = rowBegin; i < rowEnd; ++i) {
+        loadPaddedRow(src, i + 1, rows[2]);
+        uint64_t* out = dst.rowWords(i);
+        if (!bitboardTrivialRow(out, stride, U)) {
+            rowFn(rows[0] + 1, rows[1] + 1, rows[2] + 1, out, stride, U);
+        }
+        out[stride - 1] &= mask;
+        // Rotar el anillo de filas: la actual pasa a ser la superior
+        std::swap(rows[0], rows[1]);
+        std::swap(rows[1], rows[2]);
+    }
+}
+
+// Variante en el lugar: la fila superior ya está actualizada, así que se
+// vuelven a copiar las tres filas desde la grilla antes de cada fila
+void caAlternativePassBitboard(Grid& grid, int U, CAScratch& scratch,
+                               SimdLevel level = detectSimdLevel()) {
+    const size_t stride = grid.strideWords();
+    if (stride == 0) return;
+    const size_t padStride = stride + 2;
+    const uint64_t mask = lastWordMask(grid.width());
+    BitboardRowFn rowFn = bitboardRowFunction(level);
+
+    scratch.padRows.resize(3 * padStride);
+    scratch.outRow.resize(stride);
+    uint64_t* rows = scratch.padRows.data();
+    uint64_t* out = scratch.outRow.data();
+
+    for (int i = 0; i < grid.height(); ++i) {
+        loadPaddedRow(grid, i - 1, rows);
+        loadPaddedRow(grid, i, rows + padStride);
+        loadPaddedRow(grid, i + 1, rows + 2 * padStride);
+        if (!bitboardTrivialRow(out, stride, U)) {
+            rowFn(rows + 1, rows + padStride + 1, rows + 2 * padStride + 1, out, stride, U);
+        }
+        out[stride - 1] &= mask;
+        std::memcpy(grid.rowWords(i), out, stride * sizeof(uint64_t));
+    }
+}
+
+// ---------------------------------------------------------------------------
+// Kernels especializados en tiempo de compilación para R = 1..3
+// Generalizan el kernel bitboard a radios mayores con R y U como parámetros de
+// plantilla, así que los bucles sobre el vecindario se desenrollan por completo
+// y el umbral es una constante (sin ramas por celda ni por U):
+// - Suma horizontal: para cada fila de origen, los 2R+1 desplazamientos de la
+//   fila se suman en planos de bits (HB planos). Cada fila se suma una sola vez
+//   por banda y se guarda en un anillo de 2R+1 filas.
+// - Suma vertical: los 2R+1 números de HB bits del anillo se suman en TB planos
+//   con sumadores en cadena, lo que da el total de la caja incluida la celda.
+// - Umbral: vecinos = total - celda, así que vecinos >= U equivale a
+//   total >= U + celda; ambas comparaciones contra constantes se resuelven
+//   plano a plano.
+// El despacho en tiempo de ejecución (findRuleKernel) cubre las reglas usadas
+// habitualmente (todos los U para R = 1, U alrededor de la mitad del vecindario
+// para R = 2 y 3); el resto sigue por el camino genérico.
+// ---------------------------------------------------------------------------
+
+// Planos de bits necesarios para contar hasta n
+constexpr int bitsFor(int n) { return n <= 1 ? 1 : 1 + bitsFor(n / 2); }
+
+void CAScratch::reserve(const Grid& grid, int R) {
+    const size_t W = static_cast<size_t>(grid.width());
+    const size_t stride = grid.strideWords();
+    const size_t side = static_cast<size_t>(2 * std::max(1, R) + 1);
+    colSum.reserve(W + 2 * R);
+    rowChanges.reserve(W);
+    padRows.reserve(side * (stride + 2));
+    outRow.reserve(stride);
+    if (R <= 3) planeRows.reserve(side * bitsFor(static_cast<int>(side)) * stride);
+}
+
+template <int R>
+struct RuleShape {
+    static_assert(R >= 1 && R <= 3, "kernels especializados solo para R = 1..3");
+    static constexpr int Side = 2 * R + 1;
+    static constexpr int HB = bitsFor(Side);          // planos de la suma horizontal
+    static constexpr int TB = bitsFor(Side * Side);   // planos del total de la caja
+};
+
+#define PCG_LOAD_WORDS(T, var, ptr) T var; std::memcpy(&var, (ptr), sizeof(T))
+
+// Suma horizontal de las palabras [w, w + lanes) de una fila con relleno (row
+// apunta a su primera palabra real); escribe HB planos separados por stride
+template <class T, int R>
+__attribute__((always_inline)) inline void ruleHorizontalWords(const uint64_t* row, uint64_t* planes, size_t w,
+                                                               size_t stride) {
+    constexpr int HB = RuleShape<R>::HB;
+    PCG_LOAD_WORDS(T, c, row + w);
+    PCG_LOAD_WORDS(T, prev, row + w - 1);
+    PCG_LOAD_WORDS(T, next, row + w + 1);
+    T plane[HB];
+#pragma GCC unroll 4
+    for (int p = 1; p < HB; ++p) plane[p] = c ^ c;
+    plane[0] = c;
+    // La celda de la columna j-k queda en el bit de j al desplazar k a la izquierda
+#pragma GCC unroll 8
+    for (int k = 1; k <= R; ++k) {
+        const T inputs[2] = {(c << k) | (prev >> (64 - k)), (c >> k) | (next << (64 - k))};
+#pragma GCC unroll 2
+        for (int side = 0; side < 2; ++side) {
+            T carry = inputs[side];
+#pragma GCC unroll 4
+            for (int p = 0; p < HB; ++p) {
+                const T t = plane[p] & carry;
+                plane[p] ^= carry;
+                carry = t;
+            }
+        }
+    }
+#pragma GCC unroll 4
+    for (int p = 0; p < HB; ++p) std::memcpy(planes + p * stride + w, &plane[p], sizeof(T));
+}
+
+template <class V, int R>
+__attribute__((always_inline)) inline void ruleHorizontalImpl(const uint64_t* row, uint64_t* planes, size_t words,
+                                                              size_t stride) {
+    constexpr size_t lanes = sizeof(V) / sizeof(uint64_t);
+    size_t w = 0;
+    for (; w + lanes <= words; w += lanes) ruleHorizontalWords<V, R>(row, planes, w, stride);
+    for (; w < words; ++w) ruleHorizontalWords<uint64_t, R>(row, planes, w, stride);
+}
+
+// Compara total >= K desde el plano más significativo
+template <int K, int Bit, class T>
+__attribute__((always_inline)) inline void compareFromBit(const T* planes, T& gt, T& eq) {
+    if constexpr (Bit >= 0) {
+        if constexpr ((K >> Bit) & 1) {
+            eq &= planes[Bit];
+        } else {
+            gt |= eq & planes[Bit];
+            eq &= ~planes[Bit];
+        }
+        compareFromBit<K, Bit - 1>(planes, gt, eq);
+    }
+}
+
+// Máscara de celdas con total >= K
+template <int K, int TB, class T>
+__attribute__((always_inline)) inline void atLeast(const T* planes, T& mask) {
+    const T zero = planes[0] ^ planes[0];
+    if constexpr (K <= 0) {
+        mask = ~zero;
+    } else if constexpr (K >= (1 << TB)) {
+        mask = zero;
+    } else {
+        T gt = zero;
+        T eq = ~zero;
+        compareFromBit<K, TB - 1>(planes, gt, eq);
+        mask = gt | eq;
+    }
+}
+
+// Regla para las palabras [w, w + lanes): hrows son las 2R+1 sumas horizontales
+// (de arriba hacia abajo) y center la fila original de las celdas
+template <class T, int R, int U>
+__attribute__((always_inline)) inline void ruleWords(const uint64_t* const* hrows, const uint64_t* center,
+                                                     uint64_t* out, size_t w, size_t stride) {
+    constexpr int Side = RuleShape<R>::Side;
+    constexpr int HB = RuleShape<R>::HB;
+    constexpr int TB = RuleShape<R>::TB;
+    PCG_LOAD_WORDS(T, c, center + w);
+    const T zero = c ^ c;
+    T total[TB];
+#pragma GCC unroll 8
+    for (int p = 0; p < TB; ++p) {
+        if (p < HB) std::memcpy(&total[p], hrows[0] + p * stride + w, sizeof(T));
+        else total[p] = zero;
+    }
+#pragma GCC unroll 8
+    for (int r = 1; r < Side; ++r) {
+        T carry = zero;
+#pragma GCC unroll 8
+        for (int p = 0; p < TB; ++p) {
+            T b = zero;
+            if (p < HB) std::memcpy(&b, hrows[r] + p * stride + w, sizeof(T));
+            const T a = total[p];
+            const T ab = a ^ b;
+            total[p] = ab ^ carry;
+            carry = (a & b) | (carry & ab);
+        }
+    }
+    T withCell, withoutCell;
+    atLeast<U + 1, TB>(total, withCell);
+    atLeast<U, TB>(total, withoutCell);
+    const T result = (c & withCell) | (~c & withoutCell);
+    std::memcpy(out + w, &result, sizeof(T));
+}
+
+#undef PCG_LOAD_WORDS
+
+template <class V, int R, int U>
+__attribute__((always_inline)) inline void ruleRowImpl(const uint64_t* const* hrows, const uint64_t* center,
+                                                       uint64_t* out, size_t words, size_t stride) {
+    constexpr size_t lanes = sizeof(V) / sizeof(uint64_t);
+    size_t w = 0;
+    for (; w + lanes <= words; w += lanes) ruleWords<V, R, U>(hrows, center, out, w, stride);
+    for (; w < words; ++w) ruleWords<uint64_t, R, U>(hrows, center, out, w, stride);
+}
+
+using RuleHorizontalFn = void (*)(const uint64_t*, uint64_t*, size_t, size_t);
+using RuleRowFn = void (*)(const uint64_t* const*, const uint64_t*, uint64_t*, size_t, size_t);
+
+template <int R>
+void ruleHorizontalScalar(const uint64_t* row, uint64_t* planes, size_t words, size_t stride) {
+    ruleHorizontalImpl<uint64_t, R>(row, planes, words, stride);
+}
+
+template <int R, int U>
+void ruleRowScalar(const uint64_t* const* hrows, const uint64_t* center, uint64_t* out, size_t words,
+                   size_t stride) {
+    ruleRowImpl<uint64_t, R, U>(hrows, center, out, words, stride);
+}
+
+#ifdef PCG_X86_DISPATCH
+template <int R>
+__attribute__((target("avx2")))
+void ruleHorizontalAVX2(const uint64_t* row, uint64_t* planes, size_t words, size_t stride) {
+    ruleHorizontalImpl<U64x4, R>(row, planes, words, stride);
+}
+
+template <int R>
+__attribute__((target("avx512f")))
+void ruleHorizontalAVX512(const uint64_t* row, uint64_t* planes, size_t words, size_t stride) {
+    ruleHorizontalImpl<U64x8, R>(row, planes, words, stride);
+}
+
+template <int R, int U>
+__attribute__((target("avx2")))
+void ruleRowAVX2(const uint64_t* const* hrows, const uint64_t* center, uint64_t* out, size_t words,
+                 size_t stride) {
+    ruleRowImpl<U64x4, R, U>(hrows, center, out, words, stride);
+}
+
+template <int R, int U>
+__attribute__((target("avx512f")))
+void ruleRowAVX512(const uint64_t* const* hrows, const uint64_t* center, uint64_t* out, size_t words,
+                   size_t stride) {
+    ruleRowImpl<U64x8, R, U>(hrows, center, out, words, stride);
+}
+#endif
+
+// Par de funciones de una regla (R, U) para un nivel SIMD
+struct RuleKernel {
+    int R = 0;
+    RuleHorizontalFn horizontal = nullptr;
+    RuleRowFn row = nullptr;
+
+    explicit operator bool() const { return row != nullptr; }
+};
+
+template <int R, int U>
+RuleKernel ruleKernel(SimdLevel level = detectSimdLevel()) {
+#ifdef PCG_X86_DISPATCH
+    if (level == SimdLevel::AVX512) return {R, ruleHorizontalAVX512<R>, ruleRowAVX512<R, U>};
+    if (level == SimdLevel::AVX2) return {R, ruleHorizontalAVX2<R>, ruleRowAVX2<R, U>};
+#else
+    (void)level;
+#endif
+    return {R, ruleHorizontalScalar<R>, ruleRowScalar<R, U>};
+}
+
+// Reglas especializadas: U en [First, First + Count) para cada R
+template <int R, int First, int... Is>
+RuleKernel pickRuleKernel(int U, SimdLevel level, std::integer_sequence<int, Is...>) {
+    RuleKernel kernel;
+    ((U == First + Is ? (kernel = ruleKernel<R, First + Is>(level), true) : false) || ...);
+    return kernel;
+}
+
+// Kernel especializado para (R, U) o uno vacío si no hay (se usa el camino genérico)
+inline RuleKernel findRuleKernel(int R, int U, SimdLevel level = detectSimdLevel()) {
+    switch (R) {
+        case 1: return pickRuleKernel<1, 1>(U, level, std::make_integer_sequence<int, 8>{});
+        case 2: return pickRuleKernel<2, 8>(U, level, std::make_integer_sequence<int, 9>{});
+        case 3: return pickRuleKernel<3, 20>(U, level, std::make_integer_sequence<int, 9>{});
+        default: return RuleKernel{};
+    }
+}
+
+// Un paso del autómata con un kernel especializado (solo almacenamiento Bits)
+void caStepRule(const Grid& src, Grid& dst, const RuleKernel& kernel, int rowBegin, int rowEnd,
+                CAScratch& scratch) {
+    const size_t stride = src.strideWords();
+    if (stride == 0 || rowBegin >= rowEnd) return;
+    const int R = kernel.R;
+    const int side = 2 * R + 1;
+    const int HB = bitsFor(side);
+    const size_t padStride = stride + 2;
+    const size_t planeStride = HB * stride;
+    const uint64_t mask = lastWordMask(src.width());
+
+    // Anillos de 2R+1 filas: la fila con relleno y su suma horizontal
+    scratch.padRows.resize(side * padStride);
+    scratch.planeRows.resize(side * planeStride);
+    auto load = [&](int r) {
+        const int slot = ((r % side) + side) % side;
+        uint64_t* padded = scratch.padRows.data() + slot * padStride;
+        loadPaddedRow(src, r, padded);
+        kernel.horizontal(padded + 1, scratch.planeRows.data() + slot * planeStride, stride, stride);
+    };
+    for (int r = rowBegin - R; r < rowBegin + R; ++r) load(r);
+
+    const uint64_t* hrows[7];
+    for (int i = rowBegin; i < rowEnd; ++i) {
+        load(i + R);
+        for (int k = 0; k < side; ++k) {
+            const int slot = (((i - R + k) % side) + side) % side;
+            hrows[k] = scratch.planeRows.data() + slot * planeStride;
+        }
+        uint64_t* out = dst.rowWords(i);
+        kernel.row(hrows, src.rowWords(i), out, stride, stride);
+        out[stride - 1] &= mask;
+    }
+}
+
+void caStep(const Grid& src, Grid& dst, int R, int U, int rowBegin, int rowEnd,
+            NeighborCounting counting, CAScratch& scratch) {
+    PCG_PROFILE_SCOPE("ca_step");
+    PCG_PROFILE_COUNT(CellsProcessed, static_cast<uint64_t>(std::max(0, rowEnd - rowBegin)) * src.width());
+    if ((counting == NeighborCounting::Auto || counting == NeighborCounting::Specialized) && src.packed()) {
+        if (const RuleKernel kernel = findRuleKernel(R, U)) {
+            caStepRule(src, dst, kernel, rowBegin, rowEnd, scratch);
+            return;
+        }
+    }
+    switch (resolveCounting(counting, R, src.packed())) {
+        case NeighborCounting::Bitboard:
+            caStepBitboard(src, dst, U, rowBegin, rowEnd, scratch);
+            break;
+        case NeighborCounting::BoxSum:
+            if (src.packed()) caStepBoxSum<Grid::Storage::Bits>(src, dst, R, U, rowBegin, rowEnd, scratch.colSum);
+            else caStepBoxSum<Grid::Storage::Bytes>(src, dst, R, U, rowBegin, rowEnd, scratch.colSum);
+            break;
+        default:
+            if (src.packed()) caStepDirect<Grid::Storage::Bits>(src, dst, R, U, rowBegin, rowEnd);
+            else caStepDirect<Grid::Storage::Bytes>(src, dst, R, U, rowBegin, rowEnd);
+            break;
+    }
+}
+
+// Registro de una pasada del autómata (encabezado, una línea por iteración y
+// cierre), común a cellularAutomata y a la etapa de MapPipeline
+void logCellularAutomataStart(int R, int U, int iterations) {
+    PCG_LOG(Summary, "\n=== Cellular Automata Processing ===");
+    PCG_LOG(Summary, "Parameters: R=" << R << ", U=" << U << ", Iterations=" << iterations);
+}
+
+void logCellularAutomataIteration(int iter, int iterations, int R, int U) {
+    PCG_LOG(Detail, "CA Iteration " << (iter + 1) << "/" << iterations);
+    PCG_TRACE("ca_iteration", {"iter", double(iter)}, {"R", double(R)}, {"U", double(U)});
+}
+
+void logCellularAutomataDone() {
+    PCG_LOG(Summary, "Cellular Automata processing completed");
+}
+
+// Segundo buffer y memoria auxiliar del autómata, uno por hilo y reutilizados
+// entre llamadas (quedan reservados hasta que termina el hilo)
+struct CABuffers {
+    Grid next;
+    CAScratch scratch;
+};
+
+inline CABuffers& threadCABuffers() {
+    thread_local CABuffers buffers;
+    return buffers;
+}
+
+// Autómata celular sobre Grid. Usa dos buffers (actual y siguiente) que se
+// intercambian en cada iteración; el siguiente es el del hilo, así que con
+// tamaños que no crecen no se reserva memoria ni dentro ni entre llamadas
+void cellularAutomata(Grid& grid, int R, int U, int iterations,
+                      NeighborCounting counting = NeighborCounting::Auto) {
+    logCellularAutomataStart(R, U, iterations);
+    PCG_PROFILE_SCOPE("cellular_automata");
+
+    CABuffers& buffers = threadCABuffers();
+    buffers.next.reset(grid.width(), grid.height(), grid.storage());
+    for (int iter = 0; iter < iterations; ++iter) {
+        logCellularAutomataIteration(iter, iterations, R, U);
+        caStep(grid, buffers.next, R, U, 0, grid.height(), counting, buffers.scratch);
+        grid.swap(buffers.next);
+    }
+
+    logCellularAutomataDone();
+}
+
+// Autómata celular que NO sobreescribe la grilla original
+// Usa una grilla temporal para calcular todos los cambios antes de aplicarlos
+Map cellularAutomata(const Map& currentMap, int W, int H, int R, int U, int iterations,
+                     NeighborCounting counting = NeighborCounting::Auto) {
+    Grid grid = Grid::fromMap(currentMap, W, H);
+    cellularAutomata(grid, R, U, iterations, counting);
+    return grid.toMap();
+}
+
+// Autómata celular con la regla fija en compilación: cellularAutomata<R, U>(grid, n).
+// En almacenamiento Bytes usa el camino genérico
+template <int R, int U>
+void cellularAutomata(Grid& grid, int iterations) {
+    if (!grid.packed()) {
+        cellularAutomata(grid, R, U, iterations);
+        return;
+    }
+    CABuffers& buffers = threadCABuffers();
+    buffers.next.reset(grid.width(), grid.height(), grid.storage());
+    const RuleKernel kernel = ruleKernel<R, U>();
+    for (int iter = 0; iter < iterations; ++iter) {
+        caStepRule(grid, buffers.next, kernel, 0, grid.height(), buffers.scratch);
+        grid.swap(buffers.next);
+    }
+}
+
+// ---------------------------------------------------------------------------
+// Estadísticas y conectividad
+// El relleno se cuenta con popcount sobre las palabras de la grilla (en modo
+// Bytes cada celda es un byte 0/1, así que popcount también da el total).
+// Las regiones conexas (4-vecindad) de celdas con un valor dado se etiquetan
+// por tramos horizontales con union-find, en dos fases:
+// - Por banda de filas, en paralelo: se extraen los tramos de cada fila y se
+//   unen con los tramos solapados de la fila anterior de la misma banda.
+// - Al final, en secuencia: se unen los tramos de las fronteras entre bandas y
+//   se acumulan tamaño y caja envolvente por raíz.
+// La raíz de cada conjunto es siempre su tramo de menor índice, así que las
+// regiones quedan numeradas en orden de su primera celda (fila por fila), sin
+// importar cuántas bandas o hilos se usaron. La fase por banda se puede correr
+// justo después de que una banda del autómata escribe sus filas (ver
+// ParallelCellularAutomata::run), mientras siguen en caché.
+// ---------------------------------------------------------------------------
+
+// Celdas con valor 1 de la grilla
+inline uint64_t countFilled(const Grid& grid) {
+    uint64_t filled = 0;
+    const uint64_t* words = grid.data();
+    for (size_t w = 0; w < grid.sizeWords(); ++w) filled += __builtin_popcountll(words[w]);
+    return filled;
+}
+
+inline int countFilled(const Map& map) {
+    int filled = 0;
+    for (const auto& row : map) filled += static_cast<int>(std::count(row.begin(), row.end(), 1));
+    return filled;
+}
+
+// Largo del tramo de celdas iguales a value desde la columna j de una fila empaquetada
+inline int packedRunLength(const uint64_t* row, int W, int j, int value) {
+    const uint64_t flip = value ? ~uint64_t(0) : 0;
+    for (int k = j; k < W; k = (k | 63) + 1) {
+        const uint64_t differs = (row[k >> 6] ^ flip) >> (k & 63);
+        if (differs) return std::min(W, k + __builtin_ctzll(differs)) - j;
+    }
+    return W - j;
+}
+
+// Región conexa: número de celdas y caja envolvente (inclusiva)
+struct RegionInfo {
+    uint64_t cells = 0;
+    int minRow = 0;
+    int minCol = 0;
+    int maxRow = 0;
+    int maxCol = 0;
+};
+
+struct MapStats {
+    int width = 0;
+    int height = 0;
+    uint64_t filled = 0;              // celdas con valor 1
+    std::vector<RegionInfo> regions;  // en orden de su primera celda
+
+    double fillPercentage() const {
+        const double cells = static_cast<double>(width) * height;
+        return cells > 0 ? 100.0 * filled / cells : 0.0;
+    }
+
+    int regionCount() const { return static_cast<int>(regions.size()); }
+
+    uint64_t largestRegion() const {
+        uint64_t largest = 0;
+        for (const auto& region : regions) largest = std::max(largest, region.cells);
+        return largest;
+    }
+};
+
+class RegionAnalyzer {
+public:
+    // value: valor de las celdas que forman regiones (1 = pasillos y habitaciones)
+    explicit RegionAnalyzer(int value = 1) : value_(value ? 1 : 0) {}
+
+    // Prepara el análisis de una grilla de W x H repartida en bands bandas
+    void begin(int W, int H, int bands) {
+        width_ = W;
+        height_ = H;
+        bands_.resize(std::max(1, bands));
+    }
+
+    // Fase por banda: tramos de las filas [rowBegin, rowEnd) y uniones dentro de la
+    // banda. Bandas distintas se pueden escanear a la vez desde hilos distintos
+    void scanBand(const Grid& grid, int band, int rowBegin, int rowEnd) {
+        Band& state = bands_[band];
+        state.runs.clear();
+        state.parent.clear();
+        state.rowBegin = rowBegin;
+        state.rowEnd = rowEnd;
+        state.filled = 0;
+        state.firstRowRuns = 0;
+        state.lastRowStart = 0;
+        const int W = grid.width();
+        size_t previous = 0;
+        for (int i = rowBegin; i < rowEnd; ++i) {
+            const size_t current = state.runs.size();
+            if (grid.packed()) {
+                // Inicios y finales de tramo de cada palabra con operaciones de bits:
+                // una celda empieza un tramo si la anterior no es del valor, y lo
+                // termina si la siguiente no lo es. Los tramos se completan en orden
+                const uint64_t* row = grid.rowWords(i);
+                const size_t words = grid.strideWords();
+                const uint64_t flip = value_ ? 0 : ~uint64_t(0);
+                size_t pendingEnd = state.runs.size();
+                uint64_t carry = 0;
+                for (size_t w = 0; w < words; ++w) {
+                    state.filled += __builtin_popcountll(row[w]);
+                    uint64_t bits = row[w] ^ flip;
+                    if (w + 1 == words) bits &= lastWordMask(W);
+                    uint64_t next = 0;
+                    if (w + 1 < words) next = (row[w + 1] ^ flip) & (w + 2 == words ? lastWordMask(W) : ~uint64_t(0));
+                    uint64_t starts = bits & ~((bits << 1) | carry);
+                    uint64_t ends = bits & ~((bits >> 1) | (next << 63));
+                    carry = bits >> 63;
+                    const int base = static_cast<int>(w * 64);
+                    for (; starts; starts &= starts - 1) addRun(state, i, base + __builtin_ctzll(starts), 0);
+                    for (; ends; ends &= ends - 1) state.runs[pendingEnd++].end = base + __builtin_ctzll(ends);
+                }
+            } else {
+                const uint8_t* row = grid.rowBytes(i);
+                for (int j = 0; j < W;) {
+                    if (row[j] != value_) {
+                        ++j;
+                        continue;
+                    }
+                    const int start = j;
+                    while (j < W && row[j] == value_) ++j;
+                    addRun(state, i, start, j - 1);
+                }
+                for (int j = 0; j < W; ++j) state.filled += row[j];
+            }
+            if (i > rowBegin) uniteRows(state.runs, state.parent, previous, current, current, state.runs.size());
+            else state.firstRowRuns = state.runs.size();
+            state.lastRowStart = current;
+            previous = current;
+        }
+    }
+
+    // Une las bandas y calcula las estadísticas
+    const MapStats& finish() {
+        stats_.width = width_;
+        stats_.height = height_;
+        stats_.filled = 0;
+        stats_.regions.clear();
+
+        // Arreglo global de padres: los de cada banda desplazados por su primer índice
+        size_t total = 0;
+        for (auto& band : bands_) {
+            band.offset = total;
+            total += band.runs.size();
+            stats_.filled += band.filled;
+        }
+        parent_.resize(total);
+        for (const auto& band : bands_) {
+            for (size_t r = 0; r < band.parent.size(); ++r) {
+                parent_[band.offset + r] = band.parent[r] + static_cast<uint32_t>(band.offset);
+            }
+        }
+
+        // Fronteras: última fila de cada banda con la primera fila de la siguiente
+        // (saltando bandas vacías, que no tienen filas)
+        const Band* above = nullptr;
+        for (const auto& band : bands_) {
+            if (band.rowBegin >= band.rowEnd) continue;
+            if (above && above->rowEnd == band.rowBegin) {
+                stitch(*above, band);
+            }
+            above = &band;
+        }
+
+        // Raíz de cada tramo; la raíz es el menor índice, así que aparece primero
+        label_.resize(total);
+        for (const auto& band : bands_) {
+            for (size_t r = 0; r < band.runs.size(); ++r) {
+                const size_t index = band.offset + r;
+                const uint32_t root = find(parent_, static_cast<uint32_t>(index));
+                const Run& run = band.runs[r];
+                if (root == index) {
+                    label_[index] = static_cast<uint32_t>(stats_.regions.size());
+                    RegionInfo region;
+                    region.minRow = region.maxRow = run.row;
+                    region.minCol = run.start;
+                    region.maxCol = run.end;
+                    stats_.regions.push_back(region);
+                } else {
+                    label_[index] = label_[root];
+                }
+                RegionInfo& region = stats_.regions[label_[index]];
+                region.cells += static_cast<uint64_t>(run.end - run.start + 1);
+                region.maxRow = std::max(region.maxRow, run.row);
+                region.minCol = std::min(region.minCol, run.start);
+                region.maxCol = std::max(region.maxCol, run.end);
+            }
+        }
+        return stats_;
+    }
+
+    // Análisis completo de una grilla, por bandas en el pool
+    const MapStats& analyze(const Grid& grid, ThreadPool& pool = defaultThreadPool()) {
+        PCG_PROFILE_SCOPE("region_analysis");
+        const int H = grid.height();
+        const int bands = std::max(1, std::min(pool.size() * 4, H / 16));
+        begin(grid.width(), H, bands);
+        pool.parallelFor(bands, [&](int band, int) {
+            scanBand(grid, band, static_cast<int>(static_cast<int64_t>(H) * band / bands),
+                     static_cast<int>(static_cast<int64_t>(H) * (band + 1) / bands));
+        });
+        return finish();
+    }
+
+    const MapStats& stats() const { return stats_; }
+
+private:
+    struct Run {
+        int row;
+        int start;
+        int end;
+    };
+
+    struct Band {
+        std::vector<Run> runs;
+        std::vector<uint32_t> parent;
+        int rowBegin = 0;
+        int rowEnd = 0;
+        uint64_t filled = 0;
+        size_t firstRowRuns = 0;   // tramos de la primera fila: [0, firstRowRuns)
+        size_t lastRowStart = 0;   // tramos de la última fila: [lastRowStart, runs.size())
+        size_t offset = 0;
+    };
+
+    static void addRun(Band& band, int row, int start, int end) {
+        band.parent.push_back(static_cast<uint32_t>(band.runs.size()));
+        band.runs.push_back({row, start, end});
+    }
+
+    // Raíz con compresión por mitades
+    static uint32_t find(std::vector<uint32_t>& parent, uint32_t x) {
+        while (parent[x] != x) {
+            parent[x] = parent[parent[x]];
+            x = parent[x];
+        }
+        return x;
+    }
+
+    // Une dejando como raíz el menor índice
+    static void unite(std::vector<uint32_t>& parent, uint32_t a, uint32_t b) {
+        a = find(parent, a);
+        b = find(parent, b);
+        if (a < b) parent[b] = a;
+        else if (b < a) parent[a] = b;
+    }
+
+    // Une cada tramo de la fila actual [b0, b1) con los tramos solapados (4-vecindad)
+    // de la fila anterior [a0, a1). Los tramos de la fila actual todavía son raíces,
+    // así que el primer solapamiento solo los cuelga de la raíz del de arriba
+    static void uniteRows(const std::vector<Run>& runs, std::vector<uint32_t>& parent, size_t a0, size_t a1,
+                          size_t b0, size_t b1) {
+        size_t a = a0;
+        for (size_t b = b0; b < b1 && a < a1; ++b) {
+            while (a < a1 && runs[a].end < runs[b].start) ++a;
+            for (size_t k = a; k < a1 && runs[k].start <= runs[b].end; ++k) {
+                if (parent[b] == b) parent[b] = find(parent, static_cast<uint32_t>(k));
+                else unite(parent, static_cast<uint32_t>(k), static_cast<uint32_t>(b));
+            }
+        }
+    }
+
+    void stitch(const Band& above, const Band& below) {
+        size_t a = above.lastRowStart, b = 0;
+        while (a < above.runs.size() && b < below.firstRowRuns) {
+            const Run& up = above.runs[a];
+            const Run& down = below.runs[b];
+            if (up.start <= down.end && down.start <= up.end) {
+                unite(parent_, static_cast<uint32_t>(above.offset + a), static_cast<uint32_t>(below.offset + b));
+            }
+            if (up.end < down.end) ++a;
+            else ++b;
+        }
+    }
+
+    int value_;
+    int width_ = 0;
+    int height_ = 0;
+    std::vector<Band> bands_;
+    std::vector<uint32_t> parent_;
+    std::vector<uint32_t> label_;
+    MapStats stats_;
+};
+
+// Estadísticas de una grilla en una pasada por bandas
+inline MapStats analyzeMap(const Grid& grid, ThreadPool& pool = defaultThreadPool(), int value = 1) {
+    RegionAnalyzer analyzer(value);
+    return analyzer.analyze(grid, pool);
+}
+
+// Autómata celular paralelo por bandas de filas.
+// Cada banda lee de la grilla actual (incluido su halo de R filas por encima y
+// por debajo) y escribe solo sus propias filas en la grilla siguiente, así que
+// el resultado es idéntico al de la versión secuencial para cualquier número
+// de hilos. Los dos buffers y la memoria auxiliar por hilo se reservan una vez
+// y se reutilizan entre iteraciones y entre llamadas.
+class ParallelCellularAutomata {
+public:
+    explicit ParallelCellularAutomata(ThreadPool& pool = defaultThreadPool())
+        : pool_(pool), scratch_(pool.size()) {}
+
+    // Con analyzer, la fase por banda del análisis de regiones se hace en la
+    // última iteración, sobre las filas que cada banda acaba de escribir; después
+    // basta con analyzer->finish()
+    void run(Grid& grid, int R, int U, int iterations,
+             NeighborCounting counting = NeighborCounting::Auto, RegionAnalyzer* analyzer = nullptr) {
+        run(grid, back_, R, U, iterations, counting, analyzer);
+    }
+
+    // Igual, con el segundo buffer del ping-pong puesto por quien llama (por
+    // ejemplo, de una GridArena). Al terminar, grid tiene el resultado y back
+    // el estado anterior; solo se intercambian los buffers, no se copian
+    void run(Grid& grid, Grid& back, int R, int U, int iterations,
+             NeighborCounting counting = NeighborCounting::Auto, RegionAnalyzer* analyzer = nullptr) {
+        PCG_PROFILE_SCOPE("cellular_automata");
+        back.reset(grid.width(), grid.height(), grid.storage());
+        reserveScratch(grid, R);
+        const int H = grid.height();
+        // Unas 4 bandas por hilo para repartir la carga, con un mínimo de filas por banda
+        const int minRows = std::max(16, 2 * R);
+        const int bands = std::max(1, std::min(pool_.size() * 4, H / minRows));
+        if (analyzer) analyzer->begin(grid.width(), H, bands);
+        if (analyzer && iterations <= 0) {
+            pool_.parallelFor(bands, [&](int band, int) {
+                analyzer->scanBand(grid, band, static_cast<int>(static_cast<int64_t>(H) * band / bands),
+                                   static_cast<int>(static_cast<int64_t>(H) * (band + 1) / bands));
+            });
+        }
+        for (int iter = 0; iter < iterations; ++iter) {
+            const bool scan = analyzer && iter == iterations - 1;
+            pool_.parallelFor(bands, [&](int band, int worker) {
+                int rowBegin = static_cast<int>(static_cast<int64_t>(H) * band / bands);
+                int rowEnd = static_cast<int>(static_cast<int64_t>(H) * (band + 1) / bands);
+                caStep(grid, back, R, U, rowBegin, rowEnd, counting, scratch_[worker]);
+                if (scan) analyzer->scanBand(back, band, rowBegin, rowEnd);
+            });
+            grid.swap(back);
+        }
+    }
+
+private:
+    // Reserva de antemano los buffers de todos los hilos: el reparto de bandas es
+    // dinámico y un hilo que aún no había trabajado no debe reservar a mitad de paso
+    void reserveScratch(const Grid& grid, int R) {
+        for (CAScratch& scratch : scratch_) scratch.reserve(grid, R);
+    }
+
+    ThreadPool& pool_;
+    Grid back_;
+    std::vector<CAScratch> scratch_;
+};
+
+// ---------------------------------------------------------------------------
+// Autómata celular de varios estados
+// Cada celda guarda un estado (uint8_t: suelo, muro, agua, lava, mineral...).
+// La regla es una tabla: para el estado actual s y cada estado contado c,
+// table[s][c][n] dice a qué estado pasa la celda cuando tiene n vecinos en el
+// estado c, o Keep. Los estados contados se prueban en el orden en que se
+// agregaron sus transiciones y gana la primera entrada distinta de Keep; si no
+// hay ninguna, la celda se queda igual. Así una sola pasada reemplaza a las
+// pasadas binarias separadas por material. Fuera del mapa todo es borderState.
+//
+// Los conteos por estado son un histograma por ventana: sumas por columna de
+// 2R+1 filas que se deslizan fila a fila (suma la fila que entra y resta la que
+// sale) y una ventana horizontal de 2R+1 columnas, con contadores de 8 bits en
+// bloques de 64 columnas que el compilador vectoriza; como en el ruido, hay
+// versiones AVX2/AVX-512 que se eligen al ejecutar. MultiStateCellularAutomata
+// reparte bandas de filas en el ThreadPool con dos buffers que se
+// intercambian, igual que ParallelCellularAutomata.
+// ---------------------------------------------------------------------------
+class StateGrid {
+public:
+    StateGrid() = default;
+
+    StateGrid(int W, int H, uint8_t state = 0) { reset(W, H, state); }
+
+    // Redimensiona la grilla con todas las celdas en `state`, reutilizando la
+    // memoria. Las filas se rellenan hasta un múltiplo de 64 columnas
+    void reset(int W, int H, uint8_t state = 0) {
+        W_ = std::max(0, W);
+        H_ = std::max(0, H);
+        stride_ = (static_cast<size_t>(W_) + 63) / 64 * 64;
+        cells_.assign(stride_ * H_, state);
+    }
+
+    int width() const { return W_; }
+    int height() const { return H_; }
+    size_t stride() const { return stride_; }
+
+    uint8_t* row(int i) { return cells_.data() + i * stride_; }
+    const uint8_t* row(int i) const { return cells_.data() + i * stride_; }
+
+    bool inBounds(int i, int j) const { return i >= 0 && i < H_ && j >= 0 && j < W_; }
+    uint8_t get(int i, int j) const { return row(i)[j]; }
+    void set(int i, int j, uint8_t state) { row(i)[j] = state; }
+
+    void swap(StateGrid& other) {
+        std::swap(W_, other.W_);
+        std::swap(H_, other.H_);
+        std::swap(stride_, other.stride_);
+        cells_.swap(other.cells_);
+    }
+
+    bool sameCells(const StateGrid& other) const {
+        if (W_ != other.W_ || H_ != other.H_) return false;
+        for (int i = 0; i < H_; ++i) {
+            if (std::memcmp(row(i), other.row(i), W_) != 0) return false;
+        }
+        return true;
+    }
+
+    uint64_t count(uint8_t state) const {
+        uint64_t total = 0;
+        for (int i = 0; i < H_; ++i) total += std::count(row(i), row(i) + W_, state);
+        return total;
+    }
+
+    // Celdas en 1 de mask pasan a `state` (por ejemplo, los pasillos de un agente)
+    void paint(const Grid& mask, uint8_t state) {
+        for (int i = 0; i < std::min(H_, mask.height()); ++i) {
+            for (int j = 0; j < std::min(W_, mask.width()); ++j) {
+                if (mask.get(i, j)) row(i)[j] = state;
+            }
+        }
+    }
+
+    // Adaptadores hacia/desde Grid: 0 -> off, 1 -> on; y 1 donde la celda vale state
+    static StateGrid fromGrid(const Grid& grid, uint8_t off = 0, uint8_t on = 1) {
+        StateGrid states(grid.width(), grid.height(), off);
+        states.paint(grid, on);
+        return states;
+    }
+
+    Grid toGrid(uint8_t state, Grid::Storage storage = Grid::Storage::Bits) const {
+        Grid grid(W_, H_, storage);
+        for (int i = 0; i < H_; ++i) {
+            for (int j = 0; j < W_; ++j) {
+                if (row(i)[j] == state) grid.set(i, j, 1);
+            }
+        }
+        return grid;
+    }
+
+private:
+    int W_ = 0;
+    int H_ = 0;
+    size_t stride_ = 0;
+    std::vector<uint8_t> cells_;
+};
+
+class StateRule {
+public:
+    static constexpr int kMaxStates = 8;
+    static constexpr int kMaxRadius = 7;  // (2R+1)^2 - 1 vecinos caben en 8 bits
+    static constexpr uint8_t Keep = 0xFF;
+
+    explicit StateRule(int states = 2, int R = 1, uint8_t borderState = 1)
+        : states_(std::max(1, std::min(kMaxStates, states))),
+          R_(std::max(1, std::min(kMaxRadius, R))),
+          border_(borderState),
+          countStride_(maxNeighbors() + 1),
+          table_(static_cast<size_t>(states_) * states_ * countStride_, Keep) {}
+
+    // La regla binaria del autómata (muro si hay al menos U muros alrededor)
+    static StateRule binary(int R, int U) {
+        StateRule rule(2, R, 1);
+        rule.transition(0, 1, U, rule.maxNeighbors(), 1);
+        rule.transition(1, 1, 0, U - 1, 0);
+        return rule;
+    }
+
+    // Una celda en estado from con n vecinos en estado counted, minCount <= n <= maxCount,
+    // pasa a `to` (Keep para dejar esos conteos sin regla)
+    StateRule& transition(uint8_t from, uint8_t counted, int minCount, int maxCount, uint8_t to) {
+        for (int n = std::max(0, minCount); n <= std::min(maxNeighbors(), maxCount); ++n) set(from, counted, n, to);
+        return *this;
+    }
+
+    StateRule& set(uint8_t from, uint8_t counted, int n, uint8_t to) {
+        if (from >= states_ || counted >= states_ || n < 0 || n > maxNeighbors()) return *this;
+        table_[index(from, counted, n)] = to;
+        // Orden de prueba: el de la primera transición de cada estado contado
+        uint8_t* order = order_[from].data();
+        if (std::find(order, order + orderCount_[from], counted) == order + orderCount_[from]) {
+            order[orderCount_[from]++] = counted;
+        }
+        return *this;
+    }
+
+    uint8_t next(uint8_t from, uint8_t counted, int n) const { return table_[index(from, counted, n)]; }
+
+    // Tabla de los conteos de `counted` para una celda en estado from
+    const uint8_t* table(uint8_t from, uint8_t counted) const { return table_.data() + index(from, counted, 0); }
+
+    int states() const { return states_; }
+    int radius() const { return R_; }
+    uint8_t borderState() const { return border_; }
+    int maxNeighbors() const { return (2 * R_ + 1) * (2 * R_ + 1) - 1; }
+
+    // Estados contados con alguna transición desde `from`, en orden de prioridad
+    const uint8_t* order(uint8_t from) const { return order_[from].data(); }
+    int orderCount(uint8_t from) const { return orderCount_[from]; }
+
+private:
+    size_t index(int from, int counted, int n) const {
+        return (static_cast<size_t>(from) * states_ + counted) * countStride_ + n;
+    }
+
+    int states_;
+    int R_;
+    uint8_t border_;
+    size_t countStride_;
+    std::vector<uint8_t> table_;
+    std::array<std::array<uint8_t, kMaxStates>, kMaxStates> order_{};
+    std::array<int, kMaxStates> orderCount_{};
+};
+
+// Inicializa con ruido de varios estados: cada celda toma el estado k con
+// probabilidad weights[k] / suma (como el ruido binario, depende solo de la semilla)
+void initializeStates(StateGrid& grid, const std::vector<double>& weights, uint64_t seed = randomSeed(),
+                      ThreadPool* pool = &defaultThreadPool()) {
+    const int states = std::min<int>(StateRule::kMaxStates, static_cast<int>(weights.size()));
+    double total = 0;
+    for (int k = 0; k < states; ++k) total += std::max(0.0, weights[k]);
+    if (states == 0 || total <= 0) return;
+    // Umbrales acumulados sobre valores de 32 bits
+    std::array<uint64_t, StateRule::kMaxStates> limits{};
+    double sum = 0;
+    for (int k = 0; k < states; ++k) {
+        sum += std::max(0.0, weights[k]);
+        limits[k] = static_cast<uint64_t>(sum / total * 4294967296.0);
+    }
+    limits[states - 1] = uint64_t(1) << 32;
+    const int rowsPerTask = 64;
+    const int tasks = (grid.height() + rowsPerTask - 1) / rowsPerTask;
+    auto fillTask = [&](int task, int) {
+        const int rowEnd = std::min(grid.height(), (task + 1) * rowsPerTask);
+        for (int i = task * rowsPerTask; i < rowEnd; ++i) {
+            CounterRng rng(seed, RngStage::States, static_cast<uint64_t>(i));
+            uint8_t* row = grid.row(i);
+            for (int j = 0; j < grid.width(); ++j) {
+                const uint64_t value = rng.nextU32();
+                uint8_t state = 0;
+                while (value >= limits[state]) ++state;
+                row[j] = state;
+            }
+        }
+    };
+    if (pool) {
+        pool->parallelFor(tasks, fillTask);
+    } else {
+        for (int task = 0; task < tasks; ++task) fillTask(task, 0);
+    }
+}
+
+// Sumas por columna de un estado por cada estado: col[c][x] += (in[x] == c) - (out[x] == c),
+// para las `stride` columnas (múltiplo de 64) de la fila
+__attribute__((always_inline)) inline void stateColumnsImpl(const uint8_t* in, const uint8_t* out, size_t stride,
+                                                            int states, uint8_t* colSum, size_t colStride) {
+    constexpr int lanes = 64;
+    for (int c = 0; c < states; ++c) {
+        uint8_t* col = colSum + c * colStride;
+        const uint8_t state = static_cast<uint8_t>(c);
+        for (size_t x0 = 0; x0 < stride; x0 += lanes) {
+            // Bloque local: sin él el compilador no descarta que col se solape con in/out
+            uint8_t acc[lanes];
+            for (int l = 0; l < lanes; ++l) {
+                acc[l] = static_cast<uint8_t>(col[x0 + l] + (in[x0 + l] == state) - (out[x0 + l] == state));
+            }
+            std::memcpy(col + x0, acc, lanes);
+        }
+    }
+}
+
+// Ventana horizontal: counts[c][x] = suma de col[c][x .. x + 2R] (col tiene R columnas de relleno a la izquierda)
+__attribute__((always_inline)) inline void stateWindowImpl(const uint8_t* colSum, size_t colStride, int states,
+                                                           int R, size_t stride, uint8_t* counts) {
+    constexpr int lanes = 64;
+    for (int c = 0; c < states; ++c) {
+        const uint8_t* col = colSum + c * colStride;
+        uint8_t* out = counts + c * stride;
+        for (size_t x0 = 0; x0 < stride; x0 += lanes) {
+            uint8_t acc[lanes] = {};
+            for (int d = 0; d <= 2 * R; ++d) {
+                for (int l = 0; l < lanes; ++l) acc[l] = static_cast<uint8_t>(acc[l] + col[x0 + l + d]);
+            }
+            for (int l = 0; l < lanes; ++l) out[x0 + l] = acc[l];
+        }
+    }
+}
+
+void stateColumnsScalar(const uint8_t* in, const uint8_t* out, size_t stride, int states, uint8_t* colSum,
+                        size_t colStride) {
+    stateColumnsImpl(in, out, stride, states, colSum, colStride);
+}
+
+void stateWindowScalar(const uint8_t* colSum, size_t colStride, int states, int R, size_t stride, uint8_t* counts) {
+    stateWindowImpl(colSum, colStride, states, R, stride, counts);
+}
+
+#ifdef PCG_X86_DISPATCH
+__attribute__((target("avx2")))
+void stateColumnsAVX2(const uint8_t* in, const uint8_t* out, size_t stride, int states, uint8_t* colSum,
+                      size_t colStride) {
+    stateColumnsImpl(in, out, stride, states, colSum, colStride);
+}
+
+__attribute__((target("avx2")))
+void stateWindowAVX2(const uint8_t* colSum, size_t colStride, int states, int R, size_t stride, uint8_t* counts) {
+    stateWindowImpl(colSum, colStride, states, R, stride, counts);
+}
+
+__attribute__((target("avx512f,avx512bw")))
+void stateColumnsAVX512(const uint8_t* in, const uint8_t* out, size_t stride, int states, uint8_t* colSum,
+                        size_t colStride) {
+    stateColumnsImpl(in, out, stride, states, colSum, colStride);
+}
+
+__attribute__((target("avx512f,avx512bw")))
+void stateWindowAVX512(const uint8_t* colSum, size_t colStride, int states, int R, size_t stride,
+                       uint8_t* counts) {
+    stateWindowImpl(colSum, colStride, states, R, stride, counts);
+}
+#endif
+
+struct StateHistogramKernels {
+    void (*columns)(const uint8_t*, const uint8_t*, size_t, int, uint8_t*, size_t);
+    void (*window)(const uint8_t*, size_t, int, int, size_t, uint8_t*);
+};
+
+StateHistogramKernels stateHistogramKernels(SimdLevel level = detectSimdLevel()) {
+#ifdef PCG_X86_DISPATCH
+    // Las comparaciones de bytes en registros de 512 bits necesitan AVX-512BW
+    static const bool bw = [] {
+        __builtin_cpu_init();
+        return __builtin_cpu_supports("avx512bw") != 0;
+    }();
+    if (level == SimdLevel::AVX512 && bw) return {stateColumnsAVX512, stateWindowAVX512};
+    if (level != SimdLevel::Scalar) return {stateColumnsAVX2, stateWindowAVX2};
+#else
+    (void)level;
+#endif
+    return {stateColumnsScalar, stateWindowScalar};
+}
+
+struct StateScratch {
+    std::vector<uint8_t> colSum;     // [estado][R + stride + R]
+    std::vector<uint8_t> counts;     // [estado][stride]
+    std::vector<uint8_t> borderRow;  // fila fuera del mapa: todo borderState
+    std::vector<uint8_t> noneRow;    // fila que no coincide con ningún estado
+
+    void reserve(int states, int R, size_t stride) {
+        colSum.reserve(states * (stride + 2 * R));
+        counts.reserve(states * stride);
+        borderRow.reserve(stride);
+        noneRow.reserve(stride);
+    }
+};
+
+// Un paso del autómata de varios estados para las filas [rowBegin, rowEnd):
+// lee de src y escribe en dst (misma forma que caStep)
+void stateStep(const StateGrid& src, StateGrid& dst, const StateRule& rule, int rowBegin, int rowEnd,
+               StateScratch& scratch, StateHistogramKernels kernels = stateHistogramKernels()) {
+    if (rowBegin >= rowEnd || src.width() == 0) return;
+    PCG_PROFILE_SCOPE("state_step");
+    PCG_PROFILE_COUNT(CellsProcessed, static_cast<uint64_t>(rowEnd - rowBegin) * src.width());
+    const int W = src.width();
+    const int H = src.height();
+    const int R = rule.radius();
+    const int states = rule.states();
+    const uint8_t border = rule.borderState();
+    const size_t stride = src.stride();
+    const size_t colStride = stride + 2 * R;
+    const uint8_t borderColumn = static_cast<uint8_t>(2 * R + 1);
+
+    scratch.colSum.assign(states * colStride, 0);
+    scratch.counts.resize(states * stride);
+    scratch.borderRow.assign(stride, border);
+    scratch.noneRow.assign(stride, StateRule::Keep);
+    auto rowAt = [&](int r) { return r < 0 || r >= H ? scratch.borderRow.data() : src.row(r); };
+
+    // Por estado, las tablas a probar en orden con su fila de conteos; la
+    // ventana incluye la celda central, que no es vecina de sí misma
+    struct Lookup {
+        const uint8_t* table;
+        const uint8_t* counts;
+        int center;
+    };
+    std::array<std::array<Lookup, StateRule::kMaxStates>, StateRule::kMaxStates> lookups;
+    std::array<int, StateRule::kMaxStates> lookupCount{};
+    for (int state = 0; state < states; ++state) {
+        lookupCount[state] = rule.orderCount(state);
+        for (int k = 0; k < rule.orderCount(state); ++k) {
+            const uint8_t counted = rule.order(state)[k];
+            lookups[state][k] = {rule.table(state, counted), scratch.counts.data() + counted * stride,
+                                 counted == state ? 1 : 0};
+        }
+    }
+
+    // Columnas de relleno a la izquierda: siempre 2R+1 celdas de borde
+    if (border < states) std::fill_n(scratch.colSum.data() + border * colStride, R, borderColumn);
+    // Ventana vertical de la primera fila de la banda
+    for (int r = rowBegin - R; r <= rowBegin + R; ++r) {
+        kernels.columns(rowAt(r), scratch.noneRow.data(), stride, states, scratch.colSum.data() + R, colStride);
+    }
+    for (int i = rowBegin; i < rowEnd; ++i) {
+        if (i > rowBegin) {
+            kernels.columns(rowAt(i + R), rowAt(i - R - 1), stride, states, scratch.colSum.data() + R, colStride);
+        }
+        // Columnas de relleno a la derecha del mapa (las sumas deslizadas ahí no valen)
+        for (int c = 0; c < states; ++c) {
+            std::fill_n(scratch.colSum.data() + c * colStride + R + W, R, c == border ? borderColumn : 0);
+        }
+        kernels.window(scratch.colSum.data(), colStride, states, R, stride, scratch.counts.data());
+
+        const uint8_t* in = src.row(i);
+        uint8_t* out = dst.row(i);
+        for (int j = 0; j < W; ++j) {
+            const uint8_t state = in[j];
+            uint8_t next = state;
+            if (state < states) {
+                for (int k = 0; k < lookupCount[state]; ++k) {
+                    const Lookup& lookup = lookups[state][k];
+                    const uint8_t to = lookup.table[lookup.counts[j] - lookup.center];
+                    if (to != StateRule::Keep) {
+                        next = to;
+                        break;
+                    }
+                }
+            }
+            out[j] = next;
+        }
+    }
+}
+
+// Autómata de varios estados en el hilo actual, con dos buffers que se intercambian
+void cellularAutomata(StateGrid& grid, const StateRule& rule, int iterations) {
+    PCG_LOG(Summary, "\n=== Multi-state Cellular Automata Processing ===");
+    PCG_LOG(Summary, "Parameters: states=" << rule.states() << ", R=" << rule.radius()
+                     << ", Iterations=" << iterations);
+    PCG_PROFILE_SCOPE("cellular_automata");
+
+    StateGrid next(grid.width(), grid.height());
+    StateScratch scratch;
+    for (int iter = 0; iter < iterations; ++iter) {
+        PCG_LOG(Detail, "CA Iteration " << (iter + 1) << "/" << iterations);
+        stateStep(grid, next, rule, 0, grid.height(), scratch);
+        grid.swap(next);
+    }
+
+    PCG_LOG(Summary, "Multi-state Cellular Automata processing completed");
+}
+
+// Versión por bandas en paralelo, con los mismos buffers reutilizables que
+// ParallelCellularAutomata (el resultado no depende del número de hilos)
+class MultiStateCellularAutomata {
+public:
+    explicit MultiStateCellularAutomata(ThreadPool& pool = defaultThreadPool())
+        : pool_(pool), scratch_(pool.size()) {}
+
+    void run(StateGrid& grid, const StateRule& rule, int iterations) { run(grid, back_, rule, iterations); }
+
+    // Con el segundo buffer puesto por quien llama; al terminar, grid tiene el resultado
+    void run(StateGrid& grid, StateGrid& back, const StateRule& rule, int iterations) {
+        PCG_PROFILE_SCOPE("cellular_automata");
+        back.reset(grid.width(), grid.height());
+        for (StateScratch& scratch : scratch_) scratch.reserve(rule.states(), rule.radius(), grid.stride());
+        const int H = grid.height();
+        // Cada banda vuelve a sumar 2R+1 filas al empezar: bandas no menores que 4R
+        const int minRows = std::max(16, 4 * rule.radius());
+        const int bands = std::max(1, std::min(pool_.size() * 4, H / minRows));
+        const StateHistogramKernels kernels = stateHistogramKernels();
+        for (int iter = 0; iter < iterations; ++iter) {
+            pool_.parallelFor(bands, [&](int band, int worker) {
+                int rowBegin = static_cast<int>(static_cast<int64_t>(H) * band / bands);
+                int rowEnd = static_cast<int>(static_cast<int64_t>(H) * (band + 1) / bands);
+                stateStep(grid, back, rule, rowBegin, rowEnd, scratch_[worker], kernels);
+            });
+            grid.swap(back);
+        }
+    }
+
+private:
+    ThreadPool& pool_;
+    StateGrid back_;
+    std::vector<StateScratch> scratch_;
+};
+
+// Copia la región [r0, r1) x [c0, c1) de src a dst a partir de (dstRow, dstCol).
+// En grillas empaquetadas las columnas de inicio deben ser múltiplos de 64
+// (se copian palabras completas); los bits de relleno de dst quedan en 0
+void copyRegion(const Grid& src, int r0, int r1, int c0, int c1, Grid& dst, int dstRow, int dstCol) {
+    if (r0 >= r1 || c0 >= c1) return;
+    if (src.packed()) {
+        const size_t firstWord = static_cast<size_t>(c0) / 64;
+        const size_t dstWord = static_cast<size_t>(dstCol) / 64;
+        const size_t words = (static_cast<size_t>(c1 - c0) + 63) / 64;
+        const int lastCol = dstCol + (c1 - c0);
+        const bool maskTail = (lastCol & 63) != 0;
+        const uint64_t tailMask = lastWordMask(lastCol);
+        for (int r = r0; r < r1; ++r) {
+            uint64_t* out = dst.rowWords(dstRow + r - r0) + dstWord;
+            std::memcpy(out, src.rowWords(r) + firstWord, words * sizeof(uint64_t));
+            if (maskTail) out[words - 1] &= tailMask;
+        }
+    } else {
+        for (int r = r0; r < r1; ++r) {
+            std::memcpy(dst.rowBytes(dstRow + r - r0) + dstCol, src.rowBytes(r) + c0, c1 - c0);
+        }
+    }
+}
+
+// Autómata celular con bloqueo temporal.
+// En lugar de recorrer toda la grilla una vez por iteración, cada baldosa
+// (del tamaño de la caché) se copia junto con un halo de k*R celdas a un buffer
+// local, avanza k generaciones ahí y solo su núcleo se escribe de vuelta.
+// Dentro del buffer local, lo que está fuera se trata como muro: en los bordes
+// reales del mapa eso es exacto, y en los bordes interiores el error avanza a lo
+// sumo R celdas por generación, así que nunca alcanza el núcleo. El tráfico con
+// la memoria principal baja aproximadamente k veces. Las baldosas se reparten
+// entre los hilos del pool y el resultado es idéntico al de la versión por iteración.
+class TemporalBlockedCellularAutomata {
+public:
+    // tileRows/tileCols = 0 eligen un tamaño de ~256 KB según el almacenamiento
+    explicit TemporalBlockedCellularAutomata(ThreadPool& pool = defaultThreadPool(),
+                                             int tileRows = 0, int tileCols = 0)
+        : pool_(pool), tileRows_(tileRows), tileCols_(tileCols), locals_(pool.size()) {}
+
+    void run(Grid& grid, int R, int U, int iterations, int generationsPerPass,
+             NeighborCounting counting = NeighborCounting::Auto) {
+        const int W = grid.width();
+        const int H = grid.height();
+        const bool packed = grid.packed();
+        // Por defecto, baldosas anchas (las filas largas amortizan el costo fijo
+        // por fila de los kernels) y tantas filas como quepan en ~256 KB
+        const int align = packed ? 64 : 1;
+        int tileCols = tileCols_ > 0 ? tileCols_ : std::min(std::max(W, 1), packed ? 65536 : 4096);
+        tileCols = (tileCols + align - 1) / align * align;
+        const int64_t tileRowBytes = packed ? tileCols / 8 : tileCols;
+        const int tileRows = tileRows_ > 0 ? tileRows_
+                                           : static_cast<int>(std::max<int64_t>(32, (256 << 10) / tileRowBytes));
+        const int tilesY = (H + tileRows - 1) / tileRows;
+        const int tilesX = (W + tileCols - 1) / tileCols;
+        back_.reset(W, H, grid.storage());
+
+        for (int done = 0; done < iterations;) {
+            const int k = std::max(1, std::min(generationsPerPass, iterations - done));
+            const int haloRows = k * R;
+            const int haloCols = (haloRows + align - 1) / align * align;
+
+            pool_.parallelFor(tilesY * tilesX, [&](int tile, int worker) {
+                const int r0 = (tile / tilesX) * tileRows;
+                const int c0 = (tile % tilesX) * tileCols;
+                const int r1 = std::min(H, r0 + tileRows);
+                const int c1 = std::min(W, c0 + tileCols);
+                const int lr0 = std::max(0, r0 - haloRows);
+                const int lr1 = std::min(H, r1 + haloRows);
+                const int lc0 = std::max(0, c0 - haloCols);
+                const int lc1 = std::min(W, c1 + haloCols);
+
+                LocalBuffers& local = locals_[worker];
+                local.current.reset(lc1 - lc0, lr1 - lr0, grid.storage());
+                local.next.reset(lc1 - lc0, lr1 - lr0, grid.storage());
+                copyRegion(grid, lr0, lr1, lc0, lc1, local.current, 0, 0);
+                for (int g = 0; g < k; ++g) {
+                    caStep(local.current, local.next, R, U, 0, local.current.height(), counting, local.scratch);
+                    local.current.swap(local.next);
+                }
+                copyRegion(local.current, r0 - lr0, r1 - lr0, c0 - lc0, c1 - lc0, back_, r0, c0);
+            });
+
+            grid.swap(back_);
+            done += k;
+        }
+    }
+
+private:
+    struct LocalBuffers {
+        Grid current;
+        Grid next;
+        CAScratch scratch;
+    };
+
+    ThreadPool& pool_;
+    int tileRows_;
+    int tileCols_;
+    Grid back_;
+    std::vector<LocalBuffers> locals_;
+};
+
+// Compara `count` celdas de la fila ra de a (desde la columna ca) con la fila rb
+// de b (desde cb). En grillas empaquetadas ca y cb deben ser múltiplos de 64 y
+// el tramo debe terminar en un múltiplo de 64 o en el borde de ambas grillas
+inline bool sameSpan(const Grid& a, int ra, int ca, const Grid& b, int rb, int cb, int count) {
+    if (a.packed()) {
+        return std::memcmp(a.rowWords(ra) + ca / 64, b.rowWords(rb) + cb / 64,
+                           (static_cast<size_t>(count) + 63) / 64 * sizeof(uint64_t)) == 0;
+    }
+    return std::memcmp(a.rowBytes(ra) + ca, b.rowBytes(rb) + cb, count) == 0;
+}
+
+// Mapa de baldosas sucias para el autómata incremental. Una baldosa está sucia
+// si alguna de sus celdas cambió desde la última vez que el autómata la dejó
+// estable: por la generación anterior o por una escritura externa (agentes).
+// Quien modifique la grilla sin pasar por aquí debe llamar a markAll()
+class DirtyTracker {
+public:
+    DirtyTracker() = default;
+
+    // tileCols debe ser múltiplo de 64 en grillas empaquetadas
+    DirtyTracker(int W, int H, int tileRows = 32, int tileCols = 256) {
+        reset(W, H, tileRows, tileCols);
+    }
+
+    // Cambia la geometría y deja todas las baldosas sucias
+    void reset(int W, int H, int tileRows, int tileCols) {
+        W_ = std::max(0, W);
+        H_ = std::max(0, H);
+        tileRows_ = std::max(1, tileRows);
+        tileCols_ = std::max(1, tileCols);
+        tilesY_ = (H_ + tileRows_ - 1) / tileRows_;
+        tilesX_ = (W_ + tileCols_ - 1) / tileCols_;
+        dirty_.assign(static_cast<size_t>(tilesY_) * tilesX_, 1);
+    }
+
+    int width() const { return W_; }
+    int height() const { return H_; }
+    int tileRows() const { return tileRows_; }
+    int tileCols() const { return tileCols_; }
+    int tilesY() const { return tilesY_; }
+    int tilesX() const { return tilesX_; }
+
+    bool dirty(int ty, int tx) const { return dirty_[static_cast<size_t>(ty) * tilesX_ + tx] != 0; }
+
+    void markTile(int ty, int tx) { dirty_[static_cast<size_t>(ty) * tilesX_ + tx] = 1; }
+
+    void markAll() { std::fill(dirty_.begin(), dirty_.end(), 1); }
+
+    void clear() { std::fill(dirty_.begin(), dirty_.end(), 0); }
+
+    // Marca las baldosas que tocan el rectángulo de filas [x0, x1] y columnas [y0, y1]
+    // (recortado). Con Atomic = true se puede llamar desde varios hilos a la vez
+    template <bool Atomic = false>
+    void markRect(int x0, int y0, int x1, int y1) {
+        x0 = std::max(x0, 0);
+        y0 = std::max(y0, 0);
+        x1 = std::min(x1, H_ - 1);
+        y1 = std::min(y1, W_ - 1);
+        if (x0 > x1 || y0 > y1) return;
+        for (int ty = x0 / tileRows_; ty <= x1 / tileRows_; ++ty) {
+            uint8_t* row = dirty_.data() + static_cast<size_t>(ty) * tilesX_;
+            for (int tx = y0 / tileCols_; tx <= y1 / tileCols_; ++tx) {
+                if constexpr (Atomic) {
+                    __atomic_store_n(&row[tx], uint8_t(1), __ATOMIC_RELAXED);
+                } else {
+                    row[tx] = 1;
+                }
+            }
+        }
+    }
+
+    size_t count() const {
+        return static_cast<size_t>(std::count(dirty_.begin(), dirty_.end(), uint8_t(1)));
+    }
+
+private:
+    int W_ = 0;
+    int H_ = 0;
+    int tileRows_ = 32;
+    int tileCols_ = 256;
+    int tilesY_ = 0;
+    int tilesX_ = 0;
+    std::vector<uint8_t> dirty_;
+};
+
+// Autómata celular incremental: en cada generación solo se evalúan las baldosas
+// sucias y las que están a menos de R celdas de una sucia; el resto ya es un
+// punto fijo de la regla, porque su vecindario no cambió. Cada baldosa activa se
+// calcula con su halo de R celdas en un buffer local (como en el bloqueo
+// temporal con k = 1) y solo las que cambiaron se escriben de vuelta y quedan
+// sucias para la generación siguiente. Así, cuando el mapa casi convergió, una
+// iteración cuesta según la actividad y no según W*H. El resultado es idéntico
+// al de cellularAutomata.
+// El DirtyTracker se conserva entre llamadas: al terminar contiene las baldosas
+// que cambiaron en la última generación, y los agentes le agregan lo que excavan.
+// Si cambian R, U o el tamaño de la grilla, todo vuelve a quedar sucio
+class IncrementalCellularAutomata {
+public:
+    explicit IncrementalCellularAutomata(ThreadPool& pool = defaultThreadPool())
+        : pool_(pool), locals_(pool.size()) {}
+
+    void run(Grid& grid, int R, int U, int iterations, DirtyTracker& dirty,
+             NeighborCounting counting = NeighborCounting::Auto) {
+        run(grid, back_, R, U, iterations, dirty, counting, [](int) {});
+    }
+
+    // Igual, con el segundo buffer puesto por quien llama (por ejemplo, de una
+    // GridArena). onIteration(iter) se llama al empezar cada generación, también
+    // en las que se saltan porque la grilla ya llegó a un punto fijo
+    template <class OnIteration>
+    void run(Grid& grid, Grid& back, int R, int U, int iterations, DirtyTracker& dirty,
+             NeighborCounting counting, OnIteration&& onIteration) {
+        PCG_PROFILE_SCOPE("cellular_automata");
+        const int W = grid.width();
+        const int H = grid.height();
+        if (dirty.width() != W || dirty.height() != H || (grid.packed() && dirty.tileCols() % 64 != 0)) {
+            dirty.reset(W, H, dirty.tileRows(), (dirty.tileCols() + 63) / 64 * 64);
+        }
+        if (R != lastR_ || U != lastU_) dirty.markAll();
+        lastR_ = R;
+        lastU_ = U;
+
+        const int tileRows = dirty.tileRows();
+        const int tileCols = dirty.tileCols();
+        const int tilesY = dirty.tilesY();
+        const int tilesX = dirty.tilesX();
+        const int haloY = (R + tileRows - 1) / tileRows;
+        const int haloX = (R + tileCols - 1) / tileCols;
+        const int haloCols = grid.packed() ? (R + 63) / 64 * 64 : R;
+        if (back.width() != W || back.height() != H || back.storage() != grid.storage()) {
+            back.reset(W, H, grid.storage());
+        }
+        changed_.resize(static_cast<size_t>(tilesY) * tilesX);
+        bands_.reserve(tilesY);
+        reserveLocals(grid, R, std::min(H, tileRows + 2 * R), std::min(W, tileCols + 2 * haloCols));
+
+        bool settled = false;
+        for (int iter = 0; iter < iterations; ++iter) {
+            onIteration(iter);
+            if (settled) continue;
+            // Baldosas activas: las sucias dilatadas por el halo de R celdas
+            near_.assign(static_cast<size_t>(tilesY) * tilesX, 0);
+            for (int ty = 0; ty < tilesY; ++ty) {
+                for (int tx = 0; tx < tilesX; ++tx) {
+                    if (!dirty.dirty(ty, tx)) continue;
+                    for (int y = std::max(0, ty - haloY); y <= std::min(tilesY - 1, ty + haloY); ++y) {
+                        uint8_t* row = near_.data() + static_cast<size_t>(y) * tilesX;
+                        std::fill(row + std::max(0, tx - haloX), row + std::min(tilesX, tx + haloX + 1), 1);
+                    }
+                }
+            }
+            // Franjas (filas de baldosas) con alguna baldosa activa
+            bands_.clear();
+            size_t activeTiles = 0;
+            int denseBands = 0;
+            for (int ty = 0; ty < tilesY; ++ty) {
+                const uint8_t* row = near_.data() + static_cast<size_t>(ty) * tilesX;
+                const int count = static_cast<int>(std::count(row, row + tilesX, uint8_t(1)));
+                if (count > 0) bands_.push_back(ty);
+                if (count * kDenseBandRatio >= tilesX) ++denseBands;
+                activeTiles += count;
+            }
+            if (bands_.empty()) {  // punto fijo: las generaciones restantes no cambian nada
+                settled = true;
+                continue;
+            }
+            tilesEvaluated_ += activeTiles;
+
+            pool_.parallelFor(static_cast<int>(bands_.size()), [&](int task, int worker) {
+                const int ty = bands_[task];
+                const int r0 = ty * tileRows;
+                const int r1 = std::min(H, r0 + tileRows);
+                const uint8_t* near = near_.data() + static_cast<size_t>(ty) * tilesX;
+                uint8_t* changed = changed_.data() + static_cast<size_t>(ty) * tilesX;
+                LocalBuffers& local = locals_[worker];
+
+                // Franja densa: se barre entera directamente sobre back (los
+                // kernels amortizan mejor filas largas que baldosas sueltas)
+                const int count = static_cast<int>(std::count(near, near + tilesX, uint8_t(1)));
+                if (count * kDenseBandRatio >= tilesX) {
+                    caStep(grid, back, R, U, r0, r1, counting, local.scratch);
+                    for (int tx = 0; tx < tilesX; ++tx) {
+                        changed[tx] = 0;
+                        if (!near[tx]) continue;
+                        const int c0 = tx * tileCols;
+                        const int c1 = std::min(W, c0 + tileCols);
+                        for (int r = r0; r < r1 && !changed[tx]; ++r) {
+                            changed[tx] = !sameSpan(back, r, c0, grid, r, c0, c1 - c0);
+                        }
+                    }
+                    return;
+                }
+
+                // Franja dispersa: cada baldosa activa se calcula con su halo en un buffer local
+                const int lr0 = std::max(0, r0 - R);
+                const int lr1 = std::min(H, r1 + R);
+                for (int tx = 0; tx < tilesX; ++tx) {
+                    changed[tx] = 0;
+                    if (!near[tx]) continue;
+                    const int c0 = tx * tileCols;
+                    const int c1 = std::min(W, c0 + tileCols);
+                    const int lc0 = std::max(0, c0 - haloCols);
+                    const int lc1 = std::min(W, c1 + haloCols);
+                    local.current.reset(lc1 - lc0, lr1 - lr0, grid.storage());
+                    local.next.reset(lc1 - lc0, lr1 - lr0, grid.storage());
+                    copyRegion(grid, lr0, lr1, lc0, lc1, local.current, 0, 0);
+                    caStep(local.current, local.next, R, U, r0 - lr0, r1 - lr0, counting, local.scratch);
+                    for (int r = r0; r < r1 && !changed[tx]; ++r) {
+                        changed[tx] = !sameSpan(local.next, r - lr0, c0 - lc0, grid, r, c0, c1 - c0);
+                    }
+                    if (changed[tx]) copyRegion(local.next, r0 - lr0, r1 - lr0, c0 - lc0, c1 - lc0, back, r0, c0);
+                }
+            });
+
+            // Escribir de vuelta solo las baldosas que cambiaron (o intercambiar
+            // los buffers si se barrió todo); las que cambiaron son las sucias ahora
+            dirty.clear();
+            if (denseBands == tilesY) {
+                grid.swap(back);
+                for (int ty = 0; ty < tilesY; ++ty) {
+                    for (int tx = 0; tx < tilesX; ++tx) {
+                        if (changed_[static_cast<size_t>(ty) * tilesX + tx]) dirty.markTile(ty, tx);
+                    }
+                }
+                continue;
+            }
+            for (int ty : bands_) {
+                const int r0 = ty * tileRows;
+                const int r1 = std::min(H, r0 + tileRows);
+                for (int tx = 0; tx < tilesX; ++tx) {
+                    if (!changed_[static_cast<size_t>(ty) * tilesX + tx]) continue;
+                    const int c0 = tx * tileCols;
+                    copyRegion(back, r0, r1, c0, std::min(W, c0 + tileCols), grid, r0, c0);
+                    dirty.markTile(ty, tx);
+                }
+            }
+        }
+    }
+
+    // Baldosas evaluadas desde que se creó el motor (para medir la actividad)
+    uint64_t tilesEvaluated() const { return tilesEvaluated_; }
+
+private:
+    // Una franja con al menos 1/kDenseBandRatio de sus baldosas activas se barre
+    // entera: una baldosa suelta cuesta unas cuatro veces más por celda
+    static constexpr int kDenseBandRatio = 4;
+
+    // Deja los buffers de todos los hilos con el tamaño de una baldosa con halo
+    // completo (la mayor posible), para no reservar a mitad de una generación
+    void reserveLocals(const Grid& grid, int R, int rows, int cols) {
+        for (LocalBuffers& local : locals_) {
+            local.current.reset(cols, rows, grid.storage());
+            local.next.reset(cols, rows, grid.storage());
+            local.scratch.reserve(grid, R);
+        }
+    }
+
+    struct LocalBuffers {
+        Grid current;
+        Grid next;
+        CAScratch scratch;
+    };
+
+    ThreadPool& pool_;
+    Grid back_;
+    std::vector<LocalBuffers> locals_;
+    std::vector<int> bands_;
+    std::vector<uint8_t> near_;
+    std::vector<uint8_t> changed_;
+    int lastR_ = -1;
+    int lastU_ = -1;
+    uint64_t tilesEvaluated_ = 0;
+};
+
+void cellularAutomataParallel(Grid& grid, int R, int U, int iterations,
+                              ThreadPool& pool = defaultThreadPool(),
+                              NeighborCounting counting = NeighborCounting::Auto) {
+    PCG_LOG(Summary, "\n=== Parallel Cellular Automata Processing (" << pool.size() << " threads) ===");
+    PCG_LOG(Summary, "Parameters: R=" << R << ", U=" << U << ", Iterations=" << iterations);
+
+    ParallelCellularAutomata engine(pool);
+    engine.run(grid, R, U, iterations, counting);
+
+    PCG_LOG(Summary, "Parallel Cellular Automata processing completed");
+}
+
+// Versión alternativa sobre Grid: procesa fila por fila y aplica los cambios
+// de cada fila al terminarla, de modo que las filas siguientes ya ven la fila actualizada
+template <Grid::Storage S>
+void caAlternativePassDirect(Grid& grid, int R, int U, std::vector<uint8_t>& rowChanges) {
+    for (int i = 0; i < grid.height(); ++i) {
+        // Calcular todos los cambios para esta fila
+        for (int j = 0; j < grid.width(); ++j) {
+            rowChanges[j] = countNeighborsDirect<S>(grid, i, j, R) >= U ? 1 : 0;
+        }
+
+        // Aplicar todos los cambios de la fila al mismo tiempo
+        for (int j = 0; j < grid.width(); ++j) {
+            writeCell<S>(grid, i, j, rowChanges[j]);
+        }
+    }
+}
+
+// Igual que la anterior pero con sumas de caja. Como la fila i se modifica
+// mientras sigue dentro de la ventana vertical, las sumas por columna se
+// corrigen con (nuevo - viejo) al aplicar sus cambios
+template <Grid::Storage S>
+void caAlternativePassBoxSum(Grid& grid, int R, int U, CAScratch& scratch) {
+    const int W = grid.width();
+    const int H = grid.height();
+    if (H == 0) return;
+    std::vector<int>& colSum = scratch.colSum;
+    std::vector<uint8_t>& rowChanges = scratch.rowChanges;
+    initColumnWindow<S>(grid, 0, R, colSum);
+    for (int i = 0; i < H; ++i) {
+        boxSumRow<S>(grid, i, R, colSum, [&](int j, int neighbors) {
+            rowChanges[j] = neighbors >= U ? 1 : 0;
+        });
+
+        int* col = colSum.data() + R;
+        for (int j = 0; j < W; ++j) {
+            col[j] += rowChanges[j] - readCell<S>(grid, i, j);
+            writeCell<S>(grid, i, j, rowChanges[j]);
+        }
+
+        if (i + 1 < H) {
+            accumulateRow<S>(grid, i - R, -1, R, colSum);
+            accumulateRow<S>(grid, i + R + 1, +1, R, colSum);
+        }
+    }
+}
+
+void caAlternativePass(Grid& grid, int R, int U, NeighborCounting counting, CAScratch& scratch) {
+    scratch.rowChanges.resize(grid.width());
+    switch (resolveCounting(counting, R, grid.packed())) {
+        case NeighborCounting::Bitboard:
+            caAlternativePassBitboard(grid, U, scratch);
+            break;
+        case NeighborCounting::BoxSum:
+            if (grid.packed()) caAlternativePassBoxSum<Grid::Storage::Bits>(grid, R, U, scratch);
+            else caAlternativePassBoxSum<Grid::Storage::Bytes>(grid, R, U, scratch);
+            break;
+        default:
+            if (grid.packed()) caAlternativePassDirect<Grid::Storage::Bits>(grid, R, U, scratch.rowChanges);
+            else caAlternativePassDirect<Grid::Storage::Bytes>(grid, R, U, scratch.rowChanges);
+            break;
+    }
+}
+
+void cellularAutomataAlternative(Grid& grid, int R, int U, int iterations,
+                                 NeighborCounting counting = NeighborCounting::Auto) {
+    PCG_LOG(Summary, "\n=== Alternative Cellular Automata (In-Place Processing) ===");
+    PCG_LOG(Summary, "Parameters: R=" << R << ", U=" << U << ", Iterations=" << iterations);
+
+    CAScratch scratch;
+    for (int iter = 0; iter < iterations; ++iter) {
+        PCG_LOG(Detail, "CA Alternative Iteration " << (iter + 1) << "/" << iterations);
+        PCG_TRACE("ca_alternative_iteration", {"iter", double(iter)}, {"R", double(R)}, {"U", double(U)});
+        caAlternativePass(grid, R, U, counting, scratch);
+    }
+
+    PCG_LOG(Summary, "Alternative Cellular Automata processing completed");
+}
+
+// Implementación alternativa del autómata celular que procesa de izquierda a derecha
+// evitando conflictos al procesar secuencialmente
+Map cellularAutomataAlternative(const Map& currentMap, int W, int H, int R, int U, int iterations,
+                                NeighborCounting counting = NeighborCounting::Auto) {
+    Grid grid = Grid::fromMap(currentMap, W, H);
+    cellularAutomataAlternative(grid, R, U, iterations, counting);
+    return grid.toMap();
+}
+
+// ---------------------------------------------------------------------------
+// Relleno por tramos para los agentes
+// Las habitaciones y los pasillos rectos se marcan como tramos de fila: el
+// rectángulo se recorta una vez y cada fila se llena con memset (Bytes) o con
+// OR de máscaras de palabra completa (Bits), en vez de celda por celda.
+// Con Atomic = true las escrituras son atómicas relajadas, para agentes que
+// marcan la misma grilla desde varios hilos (solo se escriben unos).
+// ---------------------------------------------------------------------------
+template <bool Atomic>
+inline void orWord(uint64_t& word, uint64_t mask) {
+    if constexpr (Atomic) {
+        __atomic_fetch_or(&word, mask, __ATOMIC_RELAXED);
+    } else {
+        word |= mask;
+    }
+}
+
+// Marca con 1 las columnas [j0, j1] de la fila i (sin recortar)
+template <bool Atomic = false>
+inline void fillRowSpan(Grid& grid, int i, int j0, int j1) {
+    if (j0 > j1) return;
+    if (grid.packed()) {
+        uint64_t* row = grid.rowWords(i);
+        const int w0 = j0 >> 6;
+        const int w1 = j1 >> 6;
+        const uint64_t first = ~uint64_t(0) << (j0 & 63);
+        const uint64_t last = ~uint64_t(0) >> (63 - (j1 & 63));
+        if (w0 == w1) {
+            orWord<Atomic>(row[w0], first & last);
+            return;
+        }
+        orWord<Atomic>(row[w0], first);
+        for (int w = w0 + 1; w < w1; ++w) {
+            if constexpr (Atomic) {
+                __atomic_store_n(&row[w], ~uint64_t(0), __ATOMIC_RELAXED);
+            } else {
+                row[w] = ~uint64_t(0);
+            }
+        }
+        orWord<Atomic>(row[w1], last);
+    } else if constexpr (Atomic) {
+        uint8_t* row = grid.rowBytes(i);
+        for (int j = j0; j <= j1; ++j) __atomic_store_n(&row[j], uint8_t(1), __ATOMIC_RELAXED);
+    } else {
+        std::memset(grid.rowBytes(i) + j0, 1, static_cast<size_t>(j1 - j0 + 1));
+    }
+}
+
+// Marca con 1 el rectángulo de filas [x0, x1] y columnas [y0, y1], recortado a la grilla
+template <bool Atomic = false>
+inline void fillRect(Grid& grid, int x0, int y0, int x1, int y1) {
+    x0 = std::max(x0, 0);
+    y0 = std::max(y0, 0);
+    x1 = std::min(x1, grid.height() - 1);
+    y1 = std::min(y1, grid.width() - 1);
+    if (y0 > y1) return;
+    for (int x = x0; x <= x1; ++x) fillRowSpan<Atomic>(grid, x, y0, y1);
+}
+
+// Marca con 1 el tramo recto (horizontal o vertical) entre dos celdas, ambas
+// incluidas y en cualquier orden, recortado a la grilla
+template <bool Atomic = false>
+inline void fillSegment(Grid& grid, int x0, int y0, int x1, int y1) {
+    fillRect<Atomic>(grid, std::min(x0, x1), std::min(y0, y1), std::max(x0, x1), std::max(y0, y1));
+}
+
+// Marcadores de celdas para los agentes: segment(x0, y0, x1, y1) marca un
+// pasillo recto y rect(x0, y0, x1, y1) una habitación (límites inclusivos).
+// GridMarker escribe directamente; AtomicGridMarker usa OR atómico relajado
+// sobre la palabra (o byte) de cada celda, para que varios agentes puedan marcar
+// la misma grilla a la vez. Como solo se escriben unos y nadie lee la grilla
+// mientras camina, el resultado no depende del orden entre hilos.
+// Si hay un DirtyTracker, también marca como sucias las baldosas que toca.
+template <bool Atomic>
+struct SpanMarker {
+    Grid& grid;
+    DirtyTracker* dirty = nullptr;
+
+    void segment(int x0, int y0, int x1, int y1) {
+        fillSegment<Atomic>(grid, x0, y0, x1, y1);
+        if (dirty) dirty->markRect<Atomic>(std::min(x0, x1), std::min(y0, y1), std::max(x0, x1), std::max(y0, y1));
+    }
+
+    void rect(int x0, int y0, int x1, int y1) {
+        fillRect<Atomic>(grid, x0, y0, x1, y1);
+        if (dirty) dirty->markRect<Atomic>(x0, y0, x1, y1);
+    }
+};
+
+using GridMarker = SpanMarker<false>;
+using AtomicGridMarker = SpanMarker<true>;
+
+// Cómo avanzan los agentes dentro de una fase: Stepwise revisa los límites en
+// cada paso; FastForward calcula en forma cerrada cuántos pasos caben antes del
+// borde, marca ese tramo de una vez y salta al final. Ambos consumen los mismos
+// números aleatorios, así que dan el mismo mapa para la misma semilla
+enum class WalkMode { Stepwise, FastForward };
+
+// Pasos que se pueden dar desde (x, y) en la dirección dir (Norte, Este, Sur,
+// Oeste) sin salir de una grilla de W x H; (x, y) debe estar dentro
+inline int stepsToEdge(int x, int y, int dir, int W, int H) {
+    switch (dir) {
+        case 0: return x;
+        case 1: return W - 1 - y;
+        case 2: return H - 1 - x;
+        default: return y;
+    }
+}
+
+void drunkAgent(Grid& grid, int J, int I, int roomSizeX, int roomSizeY,
+                double probGenerateRoom, double probIncreaseRoom,
+                double probChangeDirection, double probIncreaseChange,
+                int& agentX, int& agentY, uint64_t seed = randomSeed(),
+                WalkMode mode = WalkMode::FastForward, DirtyTracker* dirty = nullptr) {
+
+    PCG_PROFILE_SCOPE("drunk_agent");
+    const int W = grid.width();
+    const int H = grid.height();
+    CounterRng rng(seed, RngStage::DrunkAgent, 0);
+    GridMarker marker{grid, dirty};
+    
+    // Posición inicial aleatoria si es la primera vez
+    if (agentX == -1 || agentY == -1) {
+        agentX = rng.nextInt(H);
+        agentY = rng.nextInt(W);
+    }
+
+    // Direcciones: Norte, Este, Sur, Oeste
+    static const std::array<std::pair<int, int>, 4> directions = {{{-1,0},{0,1},{1,0},{0,-1}}};
+    double roomProb = probGenerateRoom;
+    double dirProb = probChangeDirection;
+    int dir = rng.nextInt(4);
+
+    PCG_LOG(Summary, "Drunk Agent starting at position (" << agentX << ", " << agentY << ")");
+
+    for (int j = 0; j < J; ++j) {
+        PCG_LOG(Detail, "Movement " << j + 1 << " of " << J);
+        
+        // Al final de cada movimiento, intentar generar habitación
+        if (rng.nextDouble() < roomProb) {
+            PCG_LOG(Detail, "  Generating room at (" << agentX << ", " << agentY << ")");
+            
+            // Generar habitación centrada en el agente
+            int startX = std::max(0, agentX - roomSizeX / 2);
+            int startY = std::max(0, agentY - roomSizeY / 2);
+            int endX = std::min(H - 1, startX + roomSizeX - 1);
+            int endY = std::min(W - 1, startY + roomSizeY - 1);
+            PCG_TRACE("room", {"phase", double(j)}, {"x0", double(startX)}, {"y0", double(startY)},
+                      {"x1", double(endX)}, {"y1", double(endY)});
+
+            {
+                PCG_PROFILE_SCOPE("room_stamp");
+                marker.rect(startX, startY, endX, endY);
+            }
+            PCG_PROFILE_COUNT(RoomsGenerated, 1);
+
+            roomProb = probGenerateRoom;  // Resetear probabilidad
+        } else {
+            roomProb = std::min(1.0, roomProb + probIncreaseRoom);  // Aumentar probabilidad
+        }
+
+        // Decidir cambio de dirección
+        if (rng.nextDouble() < dirProb) {
+            dir = rng.nextInt(4);
+            dirProb = probChangeDirection;  // Resetear probabilidad
+            PCG_LOG(Detail, "  Agent changed direction");
+        } else {
+            dirProb = std::min(1.0, dirProb + probIncreaseChange);  // Aumentar probabilidad
+        }
+
+        // Realizar I pasos en la dirección actual
+        if (mode == WalkMode::FastForward && grid.inBounds(agentX, agentY)) {
+            // Tramos rectos hasta el borde; cada choque con el borde gasta un
+            // paso y saca una dirección nueva, igual que paso a paso
+            int i = 0;
+            while (i < I) {
+                const int run = std::min(I - i, stepsToEdge(agentX, agentY, dir, W, H));
+                if (run > 0) {
+                    const int dx = directions[dir].first;
+                    const int dy = directions[dir].second;
+                    marker.segment(agentX + dx, agentY + dy, agentX + run * dx, agentY + run * dy);
+                    agentX += run * dx;
+                    agentY += run * dy;
+                    i += run;
+                }
+                if (i == I) break;
+                dir = rng.nextInt(4);
+                PCG_LOG(Detail, "  Agent hit boundary, changing direction");
+                PCG_TRACE("boundary_hit", {"phase", double(j)}, {"step", double(i)},
+                          {"x", double(agentX)}, {"y", double(agentY)});
+                PCG_PROFILE_COUNT(BoundaryHits, 1);
+                ++i;
+            }
+            PCG_TRACE("agent_phase", {"phase", double(j)}, {"x", double(agentX)}, {"y", double(agentY)},
+                      {"dir", double(dir)});
+            continue;
+        }
+
+        // Paso a paso: cada tramo recto (de (runX, runY) a la posición actual)
+        // se marca de una vez al cortarse
+        int runX = agentX;
+        int runY = agentY;
+        auto carveRun = [&] {
+            if (agentX != runX || agentY != runY) {
+                marker.segment(runX + directions[dir].first, runY + directions[dir].second, agentX, agentY);
+            }
+            runX = agentX;
+            runY = agentY;
+        };
+        for (int i = 0; i < I; ++i) {
+            int nextX = agentX + directions[dir].first;
+            int nextY = agentY + directions[dir].second;
+
+            // Verificar límites del mapa
+            if (nextX < 0 || nextX >= H || nextY < 0 || nextY >= W) {
+                carveRun();
+                // Cambiar dirección cuando se sale del mapa
+                dir = rng.nextInt(4);
+                PCG_LOG(Detail, "  Agent hit boundary, changing direction");
+                PCG_TRACE("boundary_hit", {"phase", double(j)}, {"step", double(i)},
+                          {"x", double(agentX)}, {"y", double(agentY)});
+                PCG_PROFILE_COUNT(BoundaryHits, 1);
+                continue;
+            }
+
+            // Mover agente (el pasillo se marca con el tramo)
+            agentX = nextX;
+            agentY = nextY;
+        }
+        carveRun();
+        PCG_TRACE("agent_phase", {"phase", double(j)}, {"x", double(agentX)}, {"y", double(agentY)},
+                  {"dir", double(dir)});
+    }
+
+    PCG_PROFILE_COUNT(RngDraws, rng.drawn());
+    PCG_LOG(Summary, "Drunk Agent finished at position (" << agentX << ", " << agentY << ")");
+}
+
+Map drunkAgent(const Map& currentMap, int W, int H, int J, int I, int roomSizeX, int roomSizeY,
+               double probGenerateRoom, double probIncreaseRoom,
+               double probChangeDirection, double probIncreaseChange,
+               int& agentX, int& agentY, uint64_t seed = randomSeed()) {
+
+    Grid grid = Grid::fromMap(currentMap, W, H);
+    drunkAgent(grid, J, I, roomSizeX, roomSizeY, probGenerateRoom, probIncreaseRoom,
+               probChangeDirection, probIncreaseChange, agentX, agentY, seed);
+    return grid.toMap();
+}
+
+// Recorrido del Drunk Agent mejorado sobre una grilla de W x H, marcando con
+// `marker` y sacando los números aleatorios de `rng`. Con quiet, los mensajes
+// del recorrido se silencian en el hilo que lo ejecuta
+template <class Marker>
+void enhancedDrunkWalk(Marker& marker, int W, int H, int J, int I, int roomSizeX, int roomSizeY,
+                       double A, double B, double C, double D, CounterRng& rng,
+                       WalkMode mode = WalkMode::FastForward, bool quiet = false) {
+    PCG_PROFILE_SCOPE("agent_walk");
+    ScopedThreadLogLevel silence(LogLevel::Silent, quiet);
+    [[maybe_unused]] const uint64_t drawsBefore = rng.drawn();
+
+    // Posición inicial aleatoria
+    int agentX = rng.nextInt(H);
+    int agentY = rng.nextInt(W);
+    
+    // Direcciones: Norte, Este, Sur, Oeste
+    static const std::array<std::pair<int, int>, 4> directions = {{{-1,0},{0,1},{1,0},{0,-1}}};
+    static const char* const dirNames[] = {"North", "East", "South", "West"};
+    
+    double roomProb = A;        // Probabilidad actual de generar habitación
+    double dirProb = C;         // Probabilidad actual de cambiar dirección
+    int currentDir = rng.nextInt(4);
+
+    PCG_LOG(Summary, "\n=== Enhanced Drunk Agent Starting ===");
+    PCG_LOG(Summary, "Initial position: (" << agentX << ", " << agentY << ")");
+    PCG_LOG(Summary, "Parameters: J=" << J << ", I=" << I << ", Room=" << roomSizeX << "x" << roomSizeY);
+    PCG_LOG(Summary, "Probabilities: A=" << A << ", B=" << B << ", C=" << C << ", D=" << D);
+
+    for (int j = 0; j < J; ++j) {
+        PCG_LOG(Detail, "\n--- Movement Phase " << (j + 1) << "/" << J << " ---");
+        PCG_LOG(Detail, "Current room probability: " << roomProb);
+        PCG_LOG(Detail, "Current direction change probability: " << dirProb);
+        
+        // Decidir si cambiar dirección al inicio de cada movimiento
+        if (rng.nextDouble() < dirProb) {
+            int newDir = rng.nextInt(4);
+            PCG_LOG(Detail, "Direction changed from " << dirNames[currentDir] << " to " << dirNames[newDir]);
+            currentDir = newDir;
+            dirProb = C;  // Resetear probabilidad de cambio de dirección
+        } else {
+            dirProb = std::min(1.0, dirProb + D);  // Aumentar probabilidad
+            PCG_LOG(Detail, "Direction maintained: " << dirNames[currentDir]);
+        }
+
+        // Realizar I pasos en la dirección actual; el tramo recorrido se marca al final
+        const int runX = agentX;
+        const int runY = agentY;
+        const int runDir = currentDir;
+        const bool inside = agentX >= 0 && agentX < H && agentY >= 0 && agentY < W;
+        if (mode == WalkMode::FastForward && inside) {
+            // Largo del tramo en forma cerrada: la fase termina en el borde
+            const int run = std::min(I, stepsToEdge(agentX, agentY, currentDir, W, H));
+            agentX += run * directions[currentDir].first;
+            agentY += run * directions[currentDir].second;
+            if (run < I) {
+                PCG_LOG(Detail, "  Hit boundary at step " << (run + 1) << ", stopping movement");
+                PCG_TRACE("boundary_hit", {"phase", double(j)}, {"step", double(run)},
+                          {"x", double(agentX)}, {"y", double(agentY)});
+                PCG_PROFILE_COUNT(BoundaryHits, 1);
+                currentDir = rng.nextInt(4);
+            }
+        } else {
+            for (int i = 0; i < I; ++i) {
+                int nextX = agentX + directions[currentDir].first;
+                int nextY = agentY + directions[currentDir].second;
+
+                // Verificar límites y detener si se sale del mapa
+                if (nextX < 0 || nextX >= H || nextY < 0 || nextY >= W) {
+                    PCG_LOG(Detail, "  Hit boundary at step " << (i + 1) << ", stopping movement");
+                    PCG_TRACE("boundary_hit", {"phase", double(j)}, {"step", double(i)},
+                              {"x", double(agentX)}, {"y", double(agentY)});
+                    PCG_PROFILE_COUNT(BoundaryHits, 1);
+                    // Cambiar dirección cuando se sale del mapa
+                    currentDir = rng.nextInt(4);
+                    break;
+                }
+
+                // Mover agente (el pasillo se marca con el tramo)
+                agentX = nextX;
+                agentY = nextY;
+            }
+        }
+        if (agentX != runX || agentY != runY) {
+            marker.segment(runX + directions[runDir].first, runY + directions[runDir].second, agentX, agentY);
+        }
+
+        PCG_LOG(Detail, "Agent position after movement: (" << agentX << ", " << agentY << ")");
+        PCG_TRACE("agent_phase", {"phase", double(j)}, {"x", double(agentX)}, {"y", double(agentY)},
+                  {"dir", double(currentDir)});
+
+        // Al final del movimiento, intentar generar habitación
+        if (rng.nextDouble() < roomProb) {
+            PCG_LOG(Detail, "Generating room at (" << agentX << ", " << agentY << ")");
+            
+            // Calcular límites de la habitación centrada en el agente
+            int startX = std::max(0, agentX - roomSizeY / 2);
+            int startY = std::max(0, agentY - roomSizeX / 2);
+            int endX = std::min(H - 1, agentX + (roomSizeY - 1) / 2);
+            int endY = std::min(W - 1, agentY + (roomSizeX - 1) / 2);
+
+            // Asegurar que la habitación se genere incluso cerca del borde
+            if (endX - startX + 1 < roomSizeY || endY - startY + 1 < roomSizeX) {
+                // Ajustar para que la habitación tenga el tamaño mínimo
+                if (endX - startX + 1 < roomSizeY) {
+                    if (startX > 0) startX = std::max(0, endX - roomSizeY + 1);
+                    else endX = std::min(H - 1, startX + roomSizeY - 1);
+                }
+                if (endY - startY + 1 < roomSizeX) {
+                    if (startY > 0) startY = std::max(0, endY - roomSizeX + 1);
+                    else endY = std::min(W - 1, startY + roomSizeX - 1);
+                }
+            }
+
+            PCG_TRACE("room", {"phase", double(j)}, {"x0", double(startX)}, {"y0", double(startY)},
+                      {"x1", double(endX)}, {"y1", double(endY)});
+
+            // Generar la habitación
+            {
+                PCG_PROFILE_SCOPE("room_stamp");
+                marker.rect(startX, startY, endX, endY);
+            }
+            PCG_PROFILE_COUNT(RoomsGenerated, 1);
+
+            roomProb = A;  // Resetear probabilidad de habitación
+            PCG_LOG(Detail, "Room generated: " << (endX - startX + 1) << "x" << (endY - startY + 1));
+        } else {
+            roomProb = std::min(1.0, roomProb + B);  // Aumentar probabilidad
+            PCG_LOG(Detail, "No room generated. New room probability: " << roomProb);
+        }
+    }
+
+    PCG_PROFILE_COUNT(RngDraws, rng.drawn() - drawsBefore);
+    PCG_LOG(Summary, "\n=== Enhanced Drunk Agent Finished ===");
+    PCG_LOG(Summary, "Final position: (" << agentX << ", " << agentY << ")");
+}
+
+// Versión mejorada del Drunk Agent con mejor control de probabilidades
+void enhancedDrunkAgent(Grid& grid, int J, int I, int roomSizeX, int roomSizeY,
+                        double A, double B, double C, double D, uint64_t seed = randomSeed(),
+                        WalkMode mode = WalkMode::FastForward, DirtyTracker* dirty = nullptr) {
+    CounterRng rng(seed, RngStage::EnhancedDrunkAgent, 0);
+    GridMarker marker{grid, dirty};
+    enhancedDrunkWalk(marker, grid.width(), grid.height(), J, I, roomSizeX, roomSizeY, A, B, C, D, rng, mode);
+}
+
+// K agentes mejorados que excavan la misma grilla a la vez, repartidos en el pool.
+// Cada agente tiene su propio estado (posición, dirección y probabilidades A/B/C/D)
+// y su propio flujo del generador: el agente k usa el flujo k de la semilla, así
+// que el agente 0 repite exactamente a enhancedDrunkAgent con la misma semilla y
+// el mapa final es la unión de los K recorridos, sin importar el número de hilos
+// (pool = nullptr para correrlos uno tras otro en el hilo actual).
+// Los mensajes por agente se silencian mientras corren (se mezclarían entre hilos)
+void multiAgentDrunkWalk(Grid& grid, int K, int J, int I, int roomSizeX, int roomSizeY,
+                         double A, double B, double C, double D, uint64_t seed = randomSeed(),
+                         ThreadPool* pool = &defaultThreadPool(), DirtyTracker* dirty = nullptr) {
+    if (K <= 0 || grid.width() == 0 || grid.height() == 0) return;
+    PCG_LOG(Summary, "Multi-agent Drunk Walk: " << K << " agents, J=" << J << ", I=" << I
+                     << ", threads=" << (pool ? pool->size() : 1));
+    AtomicGridMarker marker{grid, dirty};
+    auto walk = [&](int agent, int) {
+        CounterRng rng(seed, RngStage::EnhancedDrunkAgent, static_cast<uint64_t>(agent));
+        enhancedDrunkWalk(marker, grid.width(), grid.height(), J, I, roomSizeX, roomSizeY,
+                          A, B, C, D, rng, WalkMode::FastForward, true);
+    };
+    if (pool) {
+        pool->parallelFor(K, walk);
+    } else {
+        for (int agent = 0; agent < K; ++agent) walk(agent, 0);
+    }
+    PCG_LOG(Summary, "Multi-agent Drunk Walk completed");
+}
+
+Map enhancedDrunkAgent(Map& currentMap, int W, int H, int J, int I, int roomSizeX, int roomSizeY,
+                      double A, double B, double C, double D, uint64_t seed = randomSeed()) {
+    Grid grid = Grid::fromMap(currentMap, W, H);
+    enhancedDrunkAgent(grid, J, I, roomSizeX, roomSizeY, A, B, C, D, seed);
+    grid.toMap(currentMap);
+    return currentMap;
+}
+
+// Suma de verificación FNV-1a de las celdas, independiente del almacenamiento
+uint64_t gridChecksum(const Grid& grid) {
+    uint64_t hash = 0xCBF29CE484222325ull;
+    auto mix = [&](uint64_t word) {
+        for (int b = 0; b < 8; ++b) {
+            hash ^= (word >> (8 * b)) & 0xFF;
+            hash *= 0x100000001B3ull;
+        }
+    };
+    mix(static_cast<uint64_t>(grid.width()) | (static_cast<uint64_t>(grid.height()) << 32));
+    const size_t words = (static_cast<size_t>(grid.width()) + 63) / 64;
+    for (int i = 0; i < grid.height(); ++i) {
+        for (size_t w = 0; w < words; ++w) {
+            uint64_t word = 0;
+            if (grid.packed()) {
+                word = grid.rowWords(i)[w];
+            } else {
+                const int end = std::min(grid.width(), static_cast<int>(64 * (w + 1)));
+                for (int j = static_cast<int>(64 * w); j < end; ++j) {
+                    word |= static_cast<uint64_t>(grid.rowBytes(i)[j]) << (j & 63);
+                }
+            }
+            mix(word);
+        }
+    }
+    return hash;
+}
+
+// ---------------------------------------------------------------------------
+// Generación por lotes
+// Un trabajo (MapJob) es una semilla más un conjunto de parámetros; su mapa se
+// genera con el mismo pipeline que main(): ruido y luego outerIterations veces
+// autómata celular + agente mejorado. El resultado depende solo del trabajo,
+// no del hilo que lo ejecuta ni del orden.
+// ---------------------------------------------------------------------------
+struct GenerationParams {
+    int width = 25;
+    int height = 15;
+    double noiseDensity = 0.45;
+    int outerIterations = 3;
+    // Autómata celular
+    int caR = 1;
+    int caU = 4;
+    int caIterations = 2;
+    // Drunk Agent
+    int agentJ = 6;
+    int agentI = 4;
+    int roomSizeX = 3;
+    int roomSizeY = 3;
+    double A = 0.2;
+    double B = 0.1;
+    double C = 0.3;
+    double D = 0.08;
+};
+
+struct MapJob {
+    uint64_t seed = 0;
+    GenerationParams params;
+};
+
+// Buffers reutilizables de un hilo generador. Los mapas pequeños usan el
+// autómata completo (back y scratch); los grandes, el incremental
+struct GenerationWorkspace {
+    Grid grid;
+    Grid back;
+    CAScratch scratch;
+    IncrementalCellularAutomata ca{inlineThreadPool()};
+    DirtyTracker dirty;
+};
+
+// Área a partir de la cual generateMap usa el autómata incremental. En mapas
+// más chicos el agente ensucia casi todas las baldosas en cada iteración y el
+// seguimiento cuesta más de lo que ahorra (en lotes de 25x15 era un 10-15% más lento)
+constexpr int64_t kIncrementalCAMinCells = 512 * 512;
+
+// Marcador que además cuenta las habitaciones excavadas
+struct RoomCountingMarker {
+    GridMarker marker;
+    int rooms = 0;
+
+    void segment(int x0, int y0, int x1, int y1) { marker.segment(x0, y0, x1, y1); }
+
+    void rect(int x0, int y0, int x1, int y1) {
+        ++rooms;
+        marker.rect(x0, y0, x1, y1);
+    }
+};
+
+// Genera el mapa de un trabajo en workspace.grid, en el hilo actual. Después de
+// cada iteración exterior llama a check(iteration, grid, rooms), con las
+// habitaciones excavadas hasta ahora; si devuelve false, la generación se
+// abandona y la función devuelve false
+template <class Check>
+bool generateMapChecked(const MapJob& job, GenerationWorkspace& workspace, Check&& check) {
+    PCG_PROFILE_SCOPE("generate_map");
+    const GenerationParams& p = job.params;
+    Grid& grid = workspace.grid;
+    grid.reset(p.width, p.height, Grid::Storage::Bits);
+    initializeWithNoise(grid, p.noiseDensity, job.seed, nullptr);
+    const bool incremental = static_cast<int64_t>(p.width) * p.height >= kIncrementalCAMinCells;
+    // Después del ruido todo está sucio; luego el autómata solo vuelve a
+    // evaluar lo que cambió o lo que excavó el agente
+    if (incremental) {
+        workspace.dirty.reset(p.width, p.height, workspace.dirty.tileRows(), workspace.dirty.tileCols());
+    } else {
+        workspace.back.reset(p.width, p.height, Grid::Storage::Bits);
+    }
+    RoomCountingMarker marker{GridMarker{grid, incremental ? &workspace.dirty : nullptr}};
+    for (int iteration = 0; iteration < p.outerIterations; ++iteration) {
+        if (incremental) {
+            workspace.ca.run(grid, p.caR, p.caU, p.caIterations, workspace.dirty);
+        } else {
+            for (int iter = 0; iter < p.caIterations; ++iter) {
+                caStep(grid, workspace.back, p.caR, p.caU, 0, p.height, NeighborCounting::Auto, workspace.scratch);
+                grid.swap(workspace.back);
+            }
+        }
+        // Lo mismo que enhancedDrunkAgent con la semilla de la iteración
+        CounterRng rng(deriveSeed(job.seed, iteration), RngStage::EnhancedDrunkAgent, 0);
+        enhancedDrunkWalk(marker, p.width, p.height, p.agentJ, p.agentI, p.roomSizeX, p.roomSizeY,
+                          p.A, p.B, p.C, p.D, rng, WalkMode::FastForward);
+        if (!check(iteration, static_cast<const Grid&>(grid), marker.rooms)) return false;
+    }
+    return true;
+}
+
+void generateMap(const MapJob& job, GenerationWorkspace& workspace) {
+    generateMapChecked(job, workspace, [](int, const Grid&, int) { return true; });
+}
+
+// ---------------------------------------------------------------------------
+// Arena de grillas y pipeline de generación
+// GridArena guarda un número fijo de grillas que se reservan una vez y se
+// reutilizan: acquire() redimensiona un buffer libre sin liberar su memoria,
+// así que mientras el tamaño no crezca no hay reservas nuevas. Las etapas de
+// MapPipeline trabajan sobre buffers de la arena identificados por handle:
+// ruido y agentes escriben en el lugar y el autómata incremental usa el segundo
+// buffer de la arena para su ping-pong. Una vez caliente, una pasada completa
+// no reserva memoria. processAllocations() lo mide con los contadores del
+// proceso (solo con -DPCG_ALLOC_COUNTING): cuenta las reservas de todos los
+// hilos mientras corre una etapa, también las que no son del pipeline, así que
+// solo es exacto si no hay otro trabajo en paralelo.
+// ---------------------------------------------------------------------------
+class GridArena {
+public:
+    using Handle = int;
+
+    explicit GridArena(int capacity = 4) : grids_(std::max(1, capacity)), used_(grids_.size(), 0) {}
+
+    // Buffer libre con las dimensiones dadas y todas las celdas en 0; -1 si no queda ninguno
+    Handle acquire(int W, int H, Grid::Storage storage = Grid::Storage::Bits) {
+        for (size_t h = 0; h < grids_.size(); ++h) {
+            if (used_[h]) continue;
+            used_[h] = 1;
+            grids_[h].reset(W, H, storage);
+            return static_cast<Handle>(h);
+        }
+        return -1;
+    }
+
+    void release(Handle handle) {
+        if (handle >= 0 && handle < capacity()) used_[handle] = 0;
+    }
+
+    Grid& operator[](Handle handle) { return grids_[handle]; }
+    const Grid& operator[](Handle handle) const { return grids_[handle]; }
+
+    int capacity() const { return static_cast<int>(grids_.size()); }
+    int inUse() const { return static_cast<int>(std::count(used_.begin(), used_.end(), 1)); }
+
+private:
+    std::vector<Grid> grids_;
+    std::vector<uint8_t> used_;
+};
+
+class MapPipeline {
+public:
+    // Los dos buffers se toman ya (vacíos), así que las etapas y grid() son
+    // válidas aun antes del primer reset()
+    explicit MapPipeline(ThreadPool& pool = defaultThreadPool()) : pool_(pool), ca_(pool) {
+        current_ = arena_.acquire(0, 0);
+        back_ = arena_.acquire(0, 0);
+    }
+
+    // El autómata es el incremental: entre pasadas solo vuelve a evaluar las
+    // baldosas que cambiaron o que tocaron el ruido y los agentes
+
+    // Empieza un mapa de W x H vacío (reutiliza los buffers de la arena)
+    MapPipeline& reset(int W, int H, Grid::Storage storage = Grid::Storage::Bits) {
+        return stage([&] {
+            arena_.release(current_);
+            arena_.release(back_);
+            current_ = arena_.acquire(W, H, storage);
+            back_ = arena_.acquire(W, H, storage);
+            dirty_.reset(W, H, dirty_.tileRows(), dirty_.tileCols());
+            agentX_ = agentY_ = -1;
+        });
+    }
+
+    MapPipeline& noise(double density, uint64_t seed) {
+        return stage([&] {
+            initializeWithNoise(grid(), density, seed, &pool_);
+            dirty_.markAll();
+        });
+    }
+
+    // Mismo resultado y registro que cellularAutomata(grid, R, U, iterations)
+    MapPipeline& cellularAutomata(int R, int U, int iterations,
+                                  NeighborCounting counting = NeighborCounting::Auto) {
+        return stage([&] {
+            logCellularAutomataStart(R, U, iterations);
+            ca_.run(grid(), arena_[back_], R, U, iterations, dirty_, counting,
+                    [&](int iter) { logCellularAutomataIteration(iter, iterations, R, U); });
+            logCellularAutomataDone();
+        });
+    }
+
+    // La posición del agente se conserva entre llamadas, como en drunkAgent
+    MapPipeline& drunkAgent(int J, int I, int roomSizeX, int roomSizeY, double A, double B, double C, double D,
+                            uint64_t seed) {
+        return stage([&] {
+            ::drunkAgent(grid(), J, I, roomSizeX, roomSizeY, A, B, C, D, agentX_, agentY_, seed,
+                         WalkMode::FastForward, &dirty_);
+        });
+    }
+
+    MapPipeline& enhancedDrunkAgent(int J, int I, int roomSizeX, int roomSizeY, double A, double B, double C,
+                                    double D, uint64_t seed) {
+        return stage([&] {
+            ::enhancedDrunkAgent(grid(), J, I, roomSizeX, roomSizeY, A, B, C, D, seed, WalkMode::FastForward,
+                                 &dirty_);
+        });
+    }
+
+    // Relleno y regiones del mapa actual
+    const MapStats& analyze() {
+        const MapStats* stats = nullptr;
+        stage([&] { stats = &analyzer_.analyze(grid(), pool_); });
+        return *stats;
+    }
+
+    // Genera un trabajo completo; da el mismo mapa que generateMap
+    void run(const MapJob& job) {
+        const GenerationParams& p = job.params;
+        reset(p.width, p.height).noise(p.noiseDensity, job.seed);
+        for (int iteration = 0; iteration < p.outerIterations; ++iteration) {
+            cellularAutomata(p.caR, p.caU, p.caIterations);
+            enhancedDrunkAgent(p.agentJ, p.agentI, p.roomSizeX, p.roomSizeY, p.A, p.B, p.C, p.D,
+                               deriveSeed(job.seed, iteration));
+        }
+    }
+
+    Grid& grid() { return arena_[current_]; }
+    const Grid& grid() const { return arena_[current_]; }
+    const GridArena& arena() const { return arena_; }
+
+    // Reservas de memoria de todo el proceso (todos los hilos) mientras corrían
+    // las etapas, desde la última puesta a cero
+    uint64_t processAllocations() const { return allocations_; }
+    void resetProcessAllocationCount() { allocations_ = 0; }
+
+private:
+    template <class Fn>
+    MapPipeline& stage(Fn&& fn) {
+        const AllocationCounters before = allocationSnapshot();
+        fn();
+        allocations_ += allocationSnapshot().count - before.count;
+        return *this;
+    }
+
+    ThreadPool& pool_;
+    GridArena arena_{2};
+    GridArena::Handle current_ = -1;
+    GridArena::Handle back_ = -1;
+    IncrementalCellularAutomata ca_;
+    DirtyTracker dirty_;
+    RegionAnalyzer analyzer_;
+    int agentX_ = -1;
+    int agentY_ = -1;
+    uint64_t allocations_ = 0;
+};
+
+// Pool con robo de trabajo para lotes de trabajos independientes.
+// Cada hilo recibe un rango contiguo de índices; saca trabajos del final de su
+// propio rango y, cuando se le acaba, roba del principio del rango de otro hilo.
+// Los rangos son solo dos enteros protegidos por un mutex, así que repartir no
+// reserva memoria. Los hilos son persistentes; el hilo que llama es el worker 0.
+class WorkStealingPool {
+public:
+    explicit WorkStealingPool(int threads = ThreadPool::hardwareThreads())
+        : queues_(std::max(1, threads)) {
+        for (int t = 1; t < static_cast<int>(queues_.size()); ++t) {
+            threads_.emplace_back([this, t] { workerLoop(t); });
+        }
+    }
+
+    ~WorkStealingPool() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stop_ = true;
+        }
+        wake_.notify_all();
+        for (auto& thread : threads_) thread.join();
+    }
+
+    WorkStealingPool(const WorkStealingPool&) = delete;
+    WorkStealingPool& operator=(const WorkStealingPool&) = delete;
+
+    int size() const { return static_cast<int>(queues_.size()); }
+
+    // Trabajos robados en la última llamada a run()
+    int steals() const { return steals_.load(std::memory_order_relaxed); }
+
+    // Ejecuta fn(job, worker) para cada job de [0, count) y espera a que terminen
+    template <class Fn>
+    void run(int count, Fn&& fn) {
+        if (count <= 0) return;
+        std::lock_guard<std::mutex> turn(submit_);
+        const int workers = size();
+        for (int w = 0; w < workers; ++w) {
+            std::lock_guard<std::mutex> lock(queues_[w].mutex);
+            queues_[w].head = static_cast<int>(static_cast<int64_t>(count) * w / workers);
+            queues_[w].tail = static_cast<int>(static_cast<int64_t>(count) * (w + 1) / workers);
+        }
+        steals_.store(0, std::memory_order_relaxed);
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            invoke_ = [](void* context, int job, int worker) {
+                (*static_cast<std::remove_reference_t<Fn>*>(context))(job, worker);
+            };
+            context_ = &fn;
+            busy_ = workers - 1;
+            ++generation_;
+        }
+        wake_.notify_all();
+        drain(0);
+        std::unique_lock<std::mutex> lock(mutex_);
+        done_.wait(lock, [this] { return busy_ == 0; });
+    }
+
+private:
+    struct Queue {
+        std::mutex mutex;
+        int head = 0;
+        int tail = 0;
+    };
+
+    bool popLocal(int worker, int& job) {
+        Queue& queue = queues_[worker];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        if (queue.head >= queue.tail) return false;
+        job = --queue.tail;
+        return true;
+    }
+
+    bool steal(int worker, int& job) {
+        const int workers = size();
+        for (int k = 1; k < workers; ++k) {
+            Queue& victim = queues_[(worker + k) % workers];
+            std::lock_guard<std::mutex> lock(victim.mutex);
+            if (victim.head < victim.tail) {
+                job = victim.head++;
+                steals_.fetch_add(1, std::memory_order_relaxed);
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void drain(int worker) {
+        int job;
+        while (popLocal(worker, job) || steal(worker, job)) {
+            invoke_(context_, job, worker);
+        }
+    }
+
+    void workerLoop(int worker) {
+        uint64_t seen = 0;
+        for (;;) {
+            {
+                std::unique_lock<std::mutex> lock(mutex_);
+                wake_.wait(lock, [&] { return stop_ || generation_ != seen; });
+                if (stop_) return;
+                seen = generation_;
+            }
+            drain(worker);
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                if (--busy_ == 0) done_.notify_one();
+            }
+        }
+    }
+
+    std::vector<Queue> queues_;
+    std::vector<std::thread> threads_;
+    std::mutex submit_;
+    std::mutex mutex_;
+    std::condition_variable wake_;
+    std::condition_variable done_;
+    uint64_t generation_ = 0;
+    bool stop_ = false;
+    int busy_ = 0;
+    std::atomic<int> steals_{0};
+    void (*invoke_)(void*, int, int) = nullptr;
+    void* context_ = nullptr;
+};
+
+struct BatchStats {
+    int maps = 0;
+    double seconds = 0.0;
+    double mapsPerSecond = 0.0;
+    double cellsPerSecond = 0.0;
+    int steals = 0;
+};
+
+// Genera todos los trabajos en el pool. onMap(job, grid) se llama desde el hilo
+// que generó el mapa (puede ser cualquiera), con la grilla de su espacio de trabajo.
+// Los mensajes de la generación se silencian solo en el hilo de cada trabajo
+BatchStats runBatch(const std::vector<MapJob>& jobs, WorkStealingPool& pool,
+                    const std::function<void(int, const Grid&)>& onMap = nullptr) {
+    std::vector<GenerationWorkspace> workspaces(pool.size());
+    // Celdas de las grillas generadas (no de los parámetros pedidos) por hilo
+    std::vector<double> cellsPerWorker(pool.size(), 0.0);
+
+    auto start = std::chrono::steady_clock::now();
+    pool.run(static_cast<int>(jobs.size()), [&](int job, int worker) {
+        {
+            ScopedThreadLogLevel quiet(LogLevel::Silent);
+            generateMap(jobs[job], workspaces[worker]);
+        }
+        const Grid& grid = workspaces[worker].grid;
+        cellsPerWorker[worker] += static_cast<double>(grid.width()) * grid.height();
+        if (onMap) onMap(job, grid);
+    });
+
+    BatchStats stats;
+    stats.maps = static_cast<int>(jobs.size());
+    stats.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    stats.steals = pool.steals();
+    double cells = 0.0;
+    for (double workerCells : cellsPerWorker) cells += workerCells;
+    if (stats.seconds > 0.0) {
+        stats.mapsPerSecond = stats.maps / stats.seconds;
+        stats.cellsPerSecond = cells / stats.seconds;
+    }
+    return stats;
+}
+
+// ---------------------------------------------------------------------------
+// Búsqueda de parámetros
+// Genera muchos candidatos (combinaciones de parámetros del agente y del
+// autómata) en el pool con robo de trabajo, los puntúa por relleno,
+// conectividad y número de habitaciones y se queda con los k mejores. Cada hilo
+// guarda su propio top-k y se combinan al final, sin bloqueos.
+// Un candidato se abandona en cuanto sus estadísticas parciales muestran que
+// no puede cumplir los objetivos:
+// - Habitaciones: solo aumentan y cada recorrido agrega a lo sumo J, así que
+//   pasarse del máximo o no poder alcanzar el mínimo es definitivo.
+// - Relleno: el autómata puede subirlo o bajarlo, así que no hay una cota
+//   exacta. Por defecto (fillSlack infinito) no se abandona por relleno; con un
+//   margen finito (puntos porcentuales fuera de [minFill, maxFill]) se abandona
+//   entre iteraciones, a riesgo de descartar candidatos que sí cumplirían.
+// - Conectividad: solo al final, y solo para los candidatos que cumplieron lo
+//   anterior (el etiquetado de regiones es la parte cara de la evaluación).
+// ---------------------------------------------------------------------------
+struct SearchTargets {
+    double minFill = 35.0;          // % de celdas en 1
+    double maxFill = 75.0;
+    double targetFill = 55.0;       // relleno ideal para la puntuación
+    double minConnectivity = 0.9;   // fracción de las celdas en 1 en la región más grande
+    int minRooms = 2;
+    int maxRooms = 1000000;
+    double fillSlack = std::numeric_limits<double>::infinity();
+};
+
+// Valores a probar para cada parámetro; los demás se toman de la base. Una lista
+// vacía también deja el valor de la base (cuenta como una sola opción)
+struct SearchSpace {
+    std::vector<double> A = {0.1, 0.2, 0.3};
+    std::vector<double> B = {0.05, 0.1, 0.15};
+    std::vector<double> C = {0.2, 0.3, 0.4};
+    std::vector<double> D = {0.04, 0.08};
+    std::vector<int> caR = {1};
+    std::vector<int> caU = {3, 4, 5};
+    std::vector<int> roomSize = {3, 5};
+
+    // Opciones de cada parámetro, en el orden de las cifras de combination()
+    std::array<size_t, 7> choices() const {
+        std::array<size_t, 7> sizes = {A.size(), B.size(), C.size(), D.size(),
+                                       caR.size(), caU.size(), roomSize.size()};
+        for (size_t& size : sizes) size = std::max<size_t>(1, size);
+        return sizes;
+    }
+
+    size_t combinations() const {
+        size_t total = 1;
+        for (size_t size : choices()) total *= size;
+        return total;
+    }
+
+    // Combinación number (en base mixta, A es la cifra de menor peso)
+    GenerationParams combination(const GenerationParams& base, size_t number) const {
+        GenerationParams p = base;
+        auto pick = [&number](const auto& values, auto& field) {
+            if (values.empty()) return;
+            field = values[number % values.size()];
+            number /= values.size();
+        };
+        pick(A, p.A);
+        pick(B, p.B);
+        pick(C, p.C);
+        pick(D, p.D);
+        pick(caR, p.caR);
+        pick(caU, p.caU);
+        pick(roomSize, p.roomSizeX);
+        if (!roomSize.empty()) p.roomSizeY = p.roomSizeX;
+        return p;
+    }
+};
+
+// Todas las combinaciones del espacio; el candidato k usa la semilla deriveSeed(seed, k)
+std::vector<MapJob> gridCandidates(const GenerationParams& base, const SearchSpace& space, uint64_t seed) {
+    std::vector<MapJob> jobs(space.combinations());
+    for (size_t k = 0; k < jobs.size(); ++k) {
+        jobs[k].seed = deriveSeed(seed, k);
+        jobs[k].params = space.combination(base, k);
+    }
+    return jobs;
+}
+
+// count combinaciones elegidas al azar (con repetición) del espacio
+std::vector<MapJob> randomCandidates(const GenerationParams& base, const SearchSpace& space, int count,
+                                     uint64_t seed) {
+    std::vector<MapJob> jobs(std::max(0, count));
+    CounterRng rng(seed, RngStage::Search, 0);
+    const std::array<size_t, 7> sizes = space.choices();
+    for (size_t k = 0; k < jobs.size(); ++k) {
+        // Una cifra uniforme por parámetro
+        size_t number = 0, weight = 1;
+        for (size_t size : sizes) {
+            number += static_cast<size_t>(rng.nextInt(static_cast<int>(size))) * weight;
+            weight *= size;
+        }
+        jobs[k].seed = deriveSeed(seed, k);
+        jobs[k].params = space.combination(base, number);
+    }
+    return jobs;
+}
+
+struct SearchCandidate {
+    int index = 0;            // posición en la lista de candidatos
+    MapJob job;
+    double fill = 0.0;
+    double connectivity = 0.0;
+    int regions = 0;
+    int rooms = 0;
+    double score = 0.0;
+};
+
+struct SearchResult {
+    std::vector<SearchCandidate> best;   // de mayor a menor puntuación
+    int candidates = 0;
+    int accepted = 0;
+    int rejected = 0;                    // generados completos que no cumplen
+    int aborted = 0;                     // abandonados antes de terminar
+    double seconds = 0.0;
+};
+
+// Orden del top-k: mayor puntuación primero; a igual puntuación, menor índice
+inline bool betterCandidate(const SearchCandidate& a, const SearchCandidate& b) {
+    if (a.score != b.score) return a.score > b.score;
+    return a.index < b.index;
+}
+
+SearchResult searchParameters(const std::vector<MapJob>& candidates, const SearchTargets& targets, int topK,
+                              WorkStealingPool& pool) {
+    struct Worker {
+        GenerationWorkspace workspace;
+        RegionAnalyzer analyzer;
+        std::vector<SearchCandidate> best;
+        int accepted = 0;
+        int rejected = 0;
+        int aborted = 0;
+    };
+    std::vector<Worker> workers(pool.size());
+    topK = std::max(0, topK);
+
+    auto start = std::chrono::steady_clock::now();
+    pool.run(static_cast<int>(candidates.size()), [&](int index, int w) {
+        // Solo este hilo y solo mientras evalúa el candidato (como en runBatch)
+        ScopedThreadLogLevel quiet(LogLevel::Silent);
+        Worker& worker = workers[w];
+        const MapJob& job = candidates[index];
+        const GenerationParams& p = job.params;
+        const double cells = static_cast<double>(p.width) * p.height;
+        int rooms = 0;
+        const bool finished = generateMapChecked(job, worker.workspace, [&](int iteration, const Grid& grid,
+                                                                            int roomsSoFar) {
+            rooms = roomsSoFar;
+            const int remaining = p.outerIterations - 1 - iteration;
+            // Un candidato que llegó al final se evalúa completo (y cuenta como rechazado si no cumple)
+            if (remaining == 0) return true;
+            if (roomsSoFar > targets.maxRooms) return false;
+            if (roomsSoFar + static_cast<int64_t>(remaining) * p.agentJ < targets.minRooms) return false;
+            if (targets.fillSlack == std::numeric_limits<double>::infinity()) return true;
+            const double fill = cells > 0 ? 100.0 * countFilled(grid) / cells : 0.0;
+            return fill >= targets.minFill - targets.fillSlack && fill <= targets.maxFill + targets.fillSlack;
+        });
+        if (!finished) {
+            ++worker.aborted;
+            return;
+        }
+
+        SearchCandidate candidate;
+        candidate.index = index;
+        candidate.job = job;
+        candidate.rooms = rooms;
+        const Grid& grid = worker.workspace.grid;
+        candidate.fill = cells > 0 ? 100.0 * countFilled(grid) / cells : 0.0;
+        if (candidate.fill < targets.minFill || candidate.fill > targets.maxFill || rooms < targets.minRooms ||
+            rooms > targets.maxRooms) {
+            ++worker.rejected;
+            return;
+        }
+        const MapStats& stats = worker.analyzer.analyze(grid, inlineThreadPool());
+        candidate.regions = stats.regionCount();
+        candidate.connectivity = stats.filled > 0 ? static_cast<double>(stats.largestRegion()) / stats.filled : 0.0;
+        if (candidate.connectivity < targets.minConnectivity) {
+            ++worker.rejected;
+            return;
+        }
+        candidate.score = candidate.connectivity - std::abs(candidate.fill - targets.targetFill) / 100.0;
+        ++worker.accepted;
+
+        // Top-k local, ordenado
+        auto& best = worker.best;
+        if (static_cast<int>(best.size()) == topK && (topK == 0 || !betterCandidate(candidate, best.back()))) return;
+        best.insert(std::upper_bound(best.begin(), best.end(), candidate, betterCandidate), candidate);
+        if (static_cast<int>(best.size()) > topK) best.pop_back();
+    });
+
+    SearchResult result;
+    result.candidates = static_cast<int>(candidates.size());
+    for (Worker& worker : workers) {
+        result.accepted += worker.accepted;
+        result.rejected += worker.rejected;
+        result.aborted += worker.aborted;
+        result.best.insert(result.best.end(), worker.best.begin(), worker.best.end());
+    }
+    std::sort(result.best.begin(), result.best.end(), betterCandidate);
+    if (static_cast<int>(result.best.size()) > topK) result.best.resize(topK);
+    result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return result;
+}
+
+// ---------------------------------------------------------------------------
+// Generación por trozos (chunks) para mapas más grandes que la memoria
+// El mapa se divide en trozos cuadrados de chunkSize celdas que se generan a
+// pedido: ruido + autómata celular. Como el ruido de cada celda se calcula
+// directamente desde la semilla (acceso aleatorio del generador por contador),
+// un trozo se genera solo con su ventana más un halo de iterations*R celdas, y
+// el núcleo queda idéntico al del mapa completo (misma idea que el bloqueo
+// temporal). Los agentes recorren todo el mapa en secuencia, así que no
+// participan de este modo.
+// Los trozos generados se guardan empaquetados en un archivo mapeado en memoria
+// (si se indica uno) y se mantienen residentes como mucho maxResidentChunks a la
+// vez, expulsando el menos usado recientemente. Sin archivo, un trozo expulsado
+// se descarta y se vuelve a generar si se pide otra vez. En ambos casos la
+// memoria usada depende del conjunto de trabajo y no del tamaño del mapa.
+// ---------------------------------------------------------------------------
+struct ChunkedMapParams {
+    int width = 0;
+    int height = 0;
+    int chunkSize = 1024;           // se redondea a múltiplo de 64
+    double noiseDensity = 0.45;
+    int caR = 1;
+    int caU = 4;
+    int caIterations = 2;
+    uint64_t seed = 0;
+    size_t maxResidentChunks = 64;
+    std::string backingFile;        // vacío = sin archivo
+};
+
+// Vista de solo lectura de un trozo residente. Es válida hasta que el trozo
+// se expulse (cualquier llamada que genere otros trozos puede expulsarlo)
+struct ChunkView {
+    const uint64_t* words = nullptr;
+    size_t strideWords = 0;
+    int row0 = 0;
+    int col0 = 0;
+    int width = 0;
+    int height = 0;
+
+    // (i, j) relativos al trozo
+    int get(int i, int j) const {
+        return static_cast<int>((words[i * strideWords + (j >> 6)] >> (j & 63)) & 1);
+    }
+};
+
+class ChunkedMap {
+public:
+    explicit ChunkedMap(const ChunkedMapParams& params, ThreadPool& pool = defaultThreadPool())
+        : params_(params), pool_(pool), locals_(pool.size()) {
+        params_.width = std::max(0, params_.width);
+        params_.height = std::max(0, params_.height);
+        params_.chunkSize = std::max(64, (params_.chunkSize + 63) / 64 * 64);
+        params_.maxResidentChunks = std::max<size_t>(1, params_.maxResidentChunks);
+        chunksX_ = (params_.width + params_.chunkSize - 1) / params_.chunkSize;
+        chunksY_ = (params_.height + params_.chunkSize - 1) / params_.chunkSize;
+        strideWords_ = static_cast<size_t>(params_.chunkSize) / 64;
+        slotWords_ = strideWords_ * params_.chunkSize;
+        const size_t chunks = static_cast<size_t>(chunksX_) * chunksY_;
+        generated_.assign(chunks, 0);
+        lastUse_.assign(chunks, 0);
+        slotOf_.assign(chunks, -1);
+        if (!params_.backingFile.empty()) mapFile(chunks);
+    }
+
+    ~ChunkedMap() {
+#ifdef PCG_HAS_MMAP
+        if (mapping_) munmap(mapping_, mappingBytes_);
+        if (fd_ >= 0) close(fd_);
+#endif
+    }
+
+    ChunkedMap(const ChunkedMap&) = delete;
+    ChunkedMap& operator=(const ChunkedMap&) = delete;
+
+    int width() const { return params_.width; }
+    int height() const { return params_.height; }
+    int chunkSize() const { return params_.chunkSize; }
+    int chunksX() const { return chunksX_; }
+    int chunksY() const { return chunksY_; }
+
+    // true si los trozos se guardan en el archivo (si no se pudo abrir, se trabaja sin él)
+    bool fileBacked() const { return mapping_ != nullptr; }
+
+    size_t residentChunks() const { return resident_.size(); }
+    uint64_t chunksGenerated() const { return chunksGenerated_; }
+
+    int get(int i, int j) {
+        const int cs = params_.chunkSize;
+        return chunk(i / cs, j / cs).get(i % cs, j % cs);
+    }
+
+    ChunkView chunk(int cy, int cx) {
+        const int index = cy * chunksX_ + cx;
+        if (!generated_[index]) {
+            ensure(&index, 1);
+        } else {
+            touch(index);
+        }
+        return view(index);
+    }
+
+    // Genera en paralelo los trozos pedidos que falten (a lo sumo maxResidentChunks)
+    void prefetch(const std::vector<std::pair<int, int>>& chunks) {
+        std::vector<int> indices;
+        for (const auto& c : chunks) indices.push_back(c.first * chunksX_ + c.second);
+        ensure(indices.data(), std::min(indices.size(), params_.maxResidentChunks));
+    }
+
+    // Recorre todos los trozos por filas, generándolos por tandas en el pool:
+    // fn(const ChunkView&) se llama en el hilo actual, en orden
+    template <class Fn>
+    void forEachChunk(Fn&& fn) {
+        const int total = chunksX_ * chunksY_;
+        const int batch = static_cast<int>(std::min<size_t>(params_.maxResidentChunks,
+                                                            static_cast<size_t>(pool_.size()) * 2));
+        std::vector<int> indices;
+        for (int first = 0; first < total; first += batch) {
+            indices.clear();
+            for (int index = first; index < std::min(total, first + batch); ++index) indices.push_back(index);
+            ensure(indices.data(), indices.size());
+            for (int index : indices) fn(view(index));
+        }
+    }
+
+private:
+    void mapFile(size_t chunks) {
+#ifdef PCG_HAS_MMAP
+        // Cada trozo empieza en su propia página y ocupa páginas completas, para
+        // que madvise pueda soltarlo al expulsarlo aunque sea más chico que una
+        // página (el relleno nunca se escribe, así que no ocupa disco)
+        const size_t pageWords = static_cast<size_t>(sysconf(_SC_PAGESIZE)) / sizeof(uint64_t);
+        slotStride_ = (slotWords_ + pageWords - 1) / pageWords * pageWords;
+        const size_t bytes = std::max<size_t>(1, chunks * slotStride_ * sizeof(uint64_t));
+        fd_ = open(params_.backingFile.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+        // ftruncate deja un archivo disperso: solo ocupa disco lo que se escribe
+        if (fd_ < 0 || ftruncate(fd_, static_cast<off_t>(bytes)) != 0) {
+            if (fd_ >= 0) close(fd_);
+            fd_ = -1;
+            return;
+        }
+        void* mapping = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd_, 0);
+        if (mapping == MAP_FAILED) {
+            close(fd_);
+            fd_ = -1;
+            return;
+        }
+        mapping_ = static_cast<uint64_t*>(mapping);
+        mappingBytes_ = bytes;
+#else
+        (void)chunks;
+#endif
+    }
+
+    ChunkView view(int index) {
+        ChunkView v;
+        v.words = slot(index);
+        v.strideWords = strideWords_;
+        v.row0 = (index / chunksX_) * params_.chunkSize;
+        v.col0 = (index % chunksX_) * params_.chunkSize;
+        v.width = std::min(params_.chunkSize, params_.width - v.col0);
+        v.height = std::min(params_.chunkSize, params_.height - v.row0);
+        return v;
+    }
+
+    uint64_t* slot(int index) {
+        if (mapping_) return mapping_ + static_cast<size_t>(index) * slotStride_;
+        return slots_[slotOf_[index]].data();
+    }
+
+    void touch(int index) {
+        lastUse_[index] = ++clock_;
+        if (std::find(resident_.begin(), resident_.end(), index) == resident_.end()) {
+            makeRoom();
+            resident_.push_back(index);
+        }
+    }
+
+    // Expulsa el trozo residente menos usado si ya no cabe otro
+    void makeRoom() {
+        if (resident_.size() < params_.maxResidentChunks) return;
+        auto victim = std::min_element(resident_.begin(), resident_.end(),
+                                       [&](int a, int b) { return lastUse_[a] < lastUse_[b]; });
+        const int index = *victim;
+        resident_.erase(victim);
+#ifdef PCG_HAS_MMAP
+        if (mapping_) {
+            // Soltar las páginas del trozo: el contenido sigue en el archivo
+            // (mapeo compartido) y vuelve a cargarse si se pide otra vez
+            madvise(slot(index), slotStride_ * sizeof(uint64_t), MADV_DONTNEED);
+            return;
+        }
+#endif
+        freeSlots_.push_back(slotOf_[index]);
+        slotOf_[index] = -1;
+        generated_[index] = 0;
+    }
+
+    // Deja residentes los trozos indicados (count <= maxResidentChunks),
+    // generando en paralelo los que falten
+    void ensure(const int* indices, size_t count) {
+        missing_.clear();
+        for (size_t k = 0; k < count; ++k) {
+            const int index = indices[k];
+            touch(index);
+            if (!generated_[index] && std::find(missing_.begin(), missing_.end(), index) == missing_.end()) {
+                missing_.push_back(index);
+            }
+        }
+        for (int index : missing_) {
+            if (!mapping_) {
+                if (freeSlots_.empty()) {
+                    slots_.emplace_back(slotWords_);
+                    freeSlots_.push_back(static_cast<int>(slots_.size()) - 1);
+                }
+                slotOf_[index] = freeSlots_.back();
+                freeSlots_.pop_back();
+            }
+        }
+        pool_.parallelFor(static_cast<int>(missing_.size()), [&](int task, int worker) {
+            generateChunk(missing_[task], slot(missing_[task]), locals_[worker]);
+        });
+        for (int index : missing_) generated_[index] = 1;
+        chunksGenerated_ += missing_.size();
+    }
+
+    struct LocalBuffers {
+        Grid current;
+        Grid next;
+        CAScratch scratch;
+        std::vector<uint64_t> rowBuffer;
+    };
+
+    // Ruido y autómata de la ventana del trozo más su halo; el núcleo va a out
+    void generateChunk(int index, uint64_t* out, LocalBuffers& local) const {
+        const int W = params_.width;
+        const int H = params_.height;
+        const int cs = params_.chunkSize;
+        const int r0 = (index / chunksX_) * cs;
+        const int c0 = (index % chunksX_) * cs;
+        const int r1 = std::min(H, r0 + cs);
+        const int c1 = std::min(W, c0 + cs);
+        const int haloRows = params_.caIterations * params_.caR;
+        const int haloCols = (haloRows + 63) / 64 * 64;
+        const int lr0 = std::max(0, r0 - haloRows);
+        const int lr1 = std::min(H, r1 + haloRows);
+        const int lc0 = std::max(0, c0 - haloCols);
+        const int lc1 = std::min(W, c1 + haloCols);
+
+        local.current.reset(lc1 - lc0, lr1 - lr0, Grid::Storage::Bits);
+        local.next.reset(lc1 - lc0, lr1 - lr0, Grid::Storage::Bits);
+        fillNoiseRows(local.current, params_.seed, noiseThreshold(params_.noiseDensity), 0, lr1 - lr0,
+                      local.rowBuffer, lr0, lc0);
+        for (int g = 0; g < params_.caIterations; ++g) {
+            caStep(local.current, local.next, params_.caR, params_.caU, 0, local.current.height(),
+                   NeighborCounting::Auto, local.scratch);
+            local.current.swap(local.next);
+        }
+
+        const size_t words = (static_cast<size_t>(c1 - c0) + 63) / 64;
+        const uint64_t tailMask = lastWordMask(c1 - c0);
+        for (int r = r0; r < r1; ++r) {
+            uint64_t* row = out + static_cast<size_t>(r - r0) * strideWords_;
+            std::memcpy(row, local.current.rowWords(r - lr0) + (c0 - lc0) / 64, words * sizeof(uint64_t));
+            row[words - 1] &= tailMask;
+            std::fill(row + words, row + strideWords_, 0);
+        }
+        for (int r = r1 - r0; r < cs; ++r) {
+            std::fill(out + static_cast<size_t>(r) * strideWords_, out + static_cast<size_t>(r + 1) * strideWords_, 0);
+        }
+    }
+
+    ChunkedMapParams params_;
+    ThreadPool& pool_;
+    std::vector<LocalBuffers> locals_;
+    int chunksX_ = 0;
+    int chunksY_ = 0;
+    size_t strideWords_ = 0;
+    size_t slotWords_ = 0;
+    std::vector<uint8_t> generated_;
+    std::vector<uint64_t> lastUse_;
+    std::vector<int> resident_;
+    std::vector<int> missing_;
+    uint64_t clock_ = 0;
+    uint64_t chunksGenerated_ = 0;
+    // Sin archivo: un buffer por trozo residente
+    std::vector<std::vector<uint64_t>> slots_;
+    std::vector<int> slotOf_;
+    std::vector<int> freeSlots_;
+    // Con archivo: todo el mapa mapeado, un trozo cada slotStride_ palabras
+    // (slotWords_ redondeado a páginas completas)
+    size_t slotStride_ = 0;
+    uint64_t* mapping_ = nullptr;
+    size_t mappingBytes_ = 0;
+    int fd_ = -1;
+};
+
+// ---------------------------------------------------------------------------
+// Formato binario de mapas (.pcgm)
+// Cabecera fija de 128 bytes seguida de la carga útil:
+// - Raw: las filas empaquetadas tal como las guarda Grid (ceil(W/64) palabras
+//   de 64 bits por fila, bits de relleno en 0). Se escribe con un solo fwrite y
+//   se puede leer sin copiar, mapeando el archivo en memoria.
+// - RLE: largos de tramos alternados (empezando por muro = 0) recorriendo las
+//   celdas fila por fila, cada uno como varint LEB128. Compacto para mapas con
+//   cavernas grandes; se decodifica a una Grid.
+// La cabecera guarda las dimensiones, la semilla, los parámetros de generación
+// y gridChecksum() del mapa. Los enteros van en little-endian (x86/ARM).
+// ---------------------------------------------------------------------------
+enum class MapEncoding : uint16_t { Raw = 0, RLE = 1 };
+
+struct MapFileHeader {
+    char magic[4];              // "PCGM"
+    uint16_t version;
+    uint16_t encoding;          // MapEncoding
+    uint32_t width;
+    uint32_t height;
+    uint64_t seed;
+    uint64_t payloadBytes;
+    uint64_t checksum;          // gridChecksum() de las celdas
+    double noiseDensity;
+    int32_t outerIterations;
+    int32_t caR;
+    int32_t caU;
+    int32_t caIterations;
+    int32_t agentJ;
+    int32_t agentI;
+    int32_t roomSizeX;
+    int32_t roomSizeY;
+    double A;
+    double B;
+    double C;
+    double D;
+    uint8_t reserved[16];
+};
+static_assert(sizeof(MapFileHeader) == 128, "la cabecera del formato debe medir 128 bytes");
+
+constexpr uint16_t kMapFileVersion = 1;
+
+// Celdas como máximo de un mapa leído (512 MB empaquetado). En RLE la cabecera
+// no está acotada por el tamaño del archivo: sin este límite, unas dimensiones
+// absurdas pasarían la validación y la reserva de la grilla fallaría al decodificar
+constexpr uint64_t kMaxMapFileCells = uint64_t(1) << 32;
+
+inline MapFileHeader makeMapFileHeader(const Grid& grid, uint64_t seed, const GenerationParams& params,
+                                       MapEncoding encoding) {
+    MapFileHeader header{};
+    std::memcpy(header.magic, "PCGM", 4);
+    header.version = kMapFileVersion;
+    header.encoding = static_cast<uint16_t>(encoding);
+    header.width = static_cast<uint32_t>(grid.width());
+    header.height = static_cast<uint32_t>(grid.height());
+    header.seed = seed;
+    header.checksum = gridChecksum(grid);
+    header.noiseDensity = params.noiseDensity;
+    header.outerIterations = params.outerIterations;
+    header.caR = params.caR;
+    header.caU = params.caU;
+    header.caIterations = params.caIterations;
+    header.agentJ = params.agentJ;
+    header.agentI = params.agentI;
+    header.roomSizeX = params.roomSizeX;
+    header.roomSizeY = params.roomSizeY;
+    header.A = params.A;
+    header.B = params.B;
+    header.C = params.C;
+    header.D = params.D;
+    return header;
+}
+
+inline GenerationParams mapFileParams(const MapFileHeader& header) {
+    GenerationParams params;
+    params.width = static_cast<int>(header.width);
+    params.height = static_cast<int>(header.height);
+    params.noiseDensity = header.noiseDensity;
+    params.outerIterations = header.outerIterations;
+    params.caR = header.caR;
+    params.caU = header.caU;
+    params.caIterations = header.caIterations;
+    params.agentJ = header.agentJ;
+    params.agentI = header.agentI;
+    params.roomSizeX = header.roomSizeX;
+    params.roomSizeY = header.roomSizeY;
+    params.A = header.A;
+    params.B = header.B;
+    params.C = header.C;
+    params.D = header.D;
+    return params;
+}
+
+inline void appendVarint(std::vector<uint8_t>& out, uint64_t value) {
+    while (value >= 0x80) {
+        out.push_back(static_cast<uint8_t>(value | 0x80));
+        value >>= 7;
+    }
+    out.push_back(static_cast<uint8_t>(value));
+}
+
+inline bool readVarint(const uint8_t*& p, const uint8_t* end, uint64_t& value) {
+    value = 0;
+    for (int shift = 0; shift < 64 && p < end; shift += 7) {
+        const uint8_t byte = *p++;
+        value |= static_cast<uint64_t>(byte & 0x7F) << shift;
+        if (!(byte & 0x80)) return true;
+    }
+    return false;
+}
+
+// Tramos alternados de la grilla (empaquetada) como varints
+void encodeMapRLE(const Grid& grid, std::vector<uint8_t>& out) {
+    out.clear();
+    const int W = grid.width();
+    int value = 0;
+    uint64_t run = 0;
+    for (int i = 0; i < grid.height(); ++i) {
+        const uint64_t* row = grid.rowWords(i);
+        for (int j = 0; j < W;) {
+            const int length = packedRunLength(row, W, j, value);
+            run += length;
+            j += length;
+            if (j < W) {
+                appendVarint(out, run);
+                run = 0;
+                value ^= 1;
+            }
+        }
+    }
+    appendVarint(out, run);
+}
+
+bool decodeMapRLE(const uint8_t* data, size_t bytes, Grid& grid) {
+    const uint8_t* p = data;
+    const uint8_t* end = data + bytes;
+    const int W = grid.width();
+    const uint64_t total = static_cast<uint64_t>(W) * grid.height();
+    uint64_t cell = 0;
+    int value = 0;
+    while (p < end) {
+        uint64_t run = 0;
+        if (!readVarint(p, end, run) || run > total - cell) return false;
+        if (value) {
+            // Un tramo de unos puede cruzar varias filas
+            for (uint64_t c = cell; c < cell + run;) {
+                const int i = static_cast<int>(c / W);
+                const int j = static_cast<int>(c % W);
+                const int last = static_cast<int>(std::min<uint64_t>(W - 1, j + (cell + run - c) - 1));
+                fillRowSpan(grid, i, j, last);
+                c += last - j + 1;
+            }
+        }
+        cell += run;
+        value ^= 1;
+    }
+    return cell == total;
+}
+
+// Escribe la grilla con su semilla y parámetros. Devuelve false si no se pudo escribir
+bool writeMapFile(const std::string& path, const Grid& grid, uint64_t seed, const GenerationParams& params,
+                  MapEncoding encoding = MapEncoding::Raw) {
+    const Grid* packed = &grid;
+    Grid converted;
+    if (!grid.packed()) {
+        converted = grid.converted(Grid::Storage::Bits);
+        packed = &converted;
+    }
+    MapFileHeader header = makeMapFileHeader(*packed, seed, params, encoding);
+    std::vector<uint8_t> rle;
+    const void* payload = packed->data();
+    header.payloadBytes = packed->sizeWords() * sizeof(uint64_t);
+    if (encoding == MapEncoding::RLE) {
+        encodeMapRLE(*packed, rle);
+        payload = rle.data();
+        header.payloadBytes = rle.size();
+    }
+
+    std::FILE* file = std::fopen(path.c_str(), "wb");
+    if (!file) return false;
+    bool ok = std::fwrite(&header, sizeof(header), 1, file) == 1;
+    if (ok && header.payloadBytes > 0) ok = std::fwrite(payload, 1, header.payloadBytes, file) == header.payloadBytes;
+    return std::fclose(file) == 0 && ok;
+}
+
+// Archivo .pcgm abierto para lectura. Con POSIX se mapea en memoria y, si la
+// codificación es Raw, las filas se leen directamente del mapeo sin copiarlas
+class MappedMapFile {
+public:
+    MappedMapFile() = default;
+    ~MappedMapFile() { close(); }
+
+    MappedMapFile(const MappedMapFile&) = delete;
+    MappedMapFile& operator=(const MappedMapFile&) = delete;
+
+    // Abre y valida la cabecera y el tamaño de la carga útil
+    bool open(const std::string& path) {
+        close();
+#ifdef PCG_HAS_MMAP
+        const int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) return false;
+        const off_t size = lseek(fd, 0, SEEK_END);
+        if (size >= static_cast<off_t>(sizeof(MapFileHeader))) {
+            void* mapping = mmap(nullptr, static_cast<size_t>(size), PROT_READ, MAP_PRIVATE, fd, 0);
+            if (mapping != MAP_FAILED) {
+                mapping_ = mapping;
+                data_ = static_cast<const uint8_t*>(mapping);
+                size_ = static_cast<size_t>(size);
+            }
+        }
+        ::close(fd);
+#else
+        std::FILE* file = std::fopen(path.c_str(), "rb");
+        if (!file) return false;
+        std::fseek(file, 0, SEEK_END);
+        const long size = std::ftell(file);
+        std::fseek(file, 0, SEEK_SET);
+        if (size > 0) {
+            buffer_.resize((static_cast<size_t>(size) + 7) / 8);
+            if (std::fread(buffer_.data(), 1, static_cast<size_t>(size), file) == static_cast<size_t>(size)) {
+                data_ = reinterpret_cast<const uint8_t*>(buffer_.data());
+                size_ = static_cast<size_t>(size);
+            }
+        }
+        std::fclose(file);
+#endif
+        if (!data_ || size_ < sizeof(MapFileHeader)) {
+            close();
+            return false;
+        }
+        std::memcpy(&header_, data_, sizeof(header_));
+        const size_t stride = (static_cast<size_t>(header_.width) + 63) / 64;
+        const bool valid = std::memcmp(header_.magic, "PCGM", 4) == 0 && header_.version == kMapFileVersion &&
+                           header_.width <= 0x7FFFFFFFu && header_.height <= 0x7FFFFFFFu &&
+                           static_cast<uint64_t>(header_.width) * header_.height <= kMaxMapFileCells &&
+                           header_.payloadBytes == size_ - sizeof(MapFileHeader) &&
+                           (header_.encoding == static_cast<uint16_t>(MapEncoding::RLE) ||
+                            (header_.encoding == static_cast<uint16_t>(MapEncoding::Raw) &&
+                             header_.payloadBytes == stride * header_.height * sizeof(uint64_t)));
+        if (!valid) {
+            close();
+            return false;
+        }
+        stride_ = stride;
+        return true;
+    }
+
+    void close() {
+#ifdef PCG_HAS_MMAP
+        if (mapping_) munmap(mapping_, size_);
+        mapping_ = nullptr;
+#else
+        buffer_.clear();
+#endif
+        data_ = nullptr;
+        size_ = 0;
+    }
+
+    bool isOpen() const { return data_ != nullptr; }
+    const MapFileHeader& header() const { return header_; }
+    GenerationParams params() const { return mapFileParams(header_); }
+    int width() const { return static_cast<int>(header_.width); }
+    int height() const { return static_cast<int>(header_.height); }
+    MapEncoding encoding() const { return static_cast<MapEncoding>(header_.encoding); }
+
+    // Acceso sin copia (solo Raw): palabras empaquetadas de la fila i
+    const uint64_t* rowWords(int i) const {
+        return reinterpret_cast<const uint64_t*>(data_ + sizeof(MapFileHeader)) + i * stride_;
+    }
+
+    int get(int i, int j) const { return static_cast<int>((rowWords(i)[j >> 6] >> (j & 63)) & 1); }
+
+    // Decodifica a una grilla empaquetada; con verify, comprueba la suma de
+    // verificación. Devuelve false (sin lanzar) si no hay memoria para la grilla
+    bool toGrid(Grid& grid, bool verify = true) const {
+        if (!isOpen()) return false;
+        try {
+            grid.reset(width(), height(), Grid::Storage::Bits);
+        } catch (const std::bad_alloc&) {
+            return false;
+        }
+        const uint8_t* payload = data_ + sizeof(MapFileHeader);
+        if (encoding() == MapEncoding::Raw) {
+            if (header_.payloadBytes > 0) std::memcpy(grid.data(), payload, header_.payloadBytes);
+        } else if (!decodeMapRLE(payload, header_.payloadBytes, grid)) {
+            return false;
+        }
+        return !verify || gridChecksum(grid) == header_.checksum;
+    }
+
+private:
+    MapFileHeader header_{};
+    const uint8_t* data_ = nullptr;
+    size_t size_ = 0;
+    size_t stride_ = 0;
+#ifdef PCG_HAS_MMAP
+    void* mapping_ = nullptr;
+#else
+    std::vector<uint64_t> buffer_;
+#endif
+};
+
+// Lee un archivo .pcgm a una grilla. Devuelve false si no existe, está
+// truncado, no es del formato o la suma de verificación no coincide
+bool readMapFile(const std::string& path, Grid& grid, MapFileHeader* header = nullptr, bool verify = true) {
+    MappedMapFile file;
+    if (!file.open(path) || !file.toGrid(grid, verify)) return false;
+    if (header) *header = file.header();
+    return true;
+}
+
+// ---------------------------------------------------------------------------
+// Suite de benchmarks
+// Harness propio (sin dependencias): recorre tamaños de mapa y parámetros de
+// cada etapa, repite cada caso hasta juntar un tiempo mínimo y escribe los
+// resultados como JSON para comparar entre versiones. Además del tiempo mide
+// reservas de memoria (contando operator new, con -DPCG_ALLOC_COUNTING) y el
+// pico de RSS de cada caso (en Linux se reinicia el pico antes de cada uno; si
+// no se puede, es el pico del proceso y el JSON lo indica).
+// ---------------------------------------------------------------------------
+
+// Valor en KB de una línea de /proc/self/status ("VmHWM:", "VmRSS:"); 0 si no está
+inline long procStatusKB(const char* key) {
+#ifdef __linux__
+    std::FILE* file = std::fopen("/proc/self/status", "r");
+    if (!file) return 0;
+    char line[256];
+    long value = 0;
+    const size_t keyLength = std::strlen(key);
+    while (std::fgets(line, sizeof(line), file)) {
+        if (std::strncmp(line, key, keyLength) == 0) {
+            value = std::strtol(line + keyLength, nullptr, 10);
+            break;
+        }
+    }
+    std::fclose(file);
+    return value;
+#else
+    (void)key;
+    return 0;
+#endif
+}
+
+// Reinicia el pico de memoria residente del proceso (Linux >= 4.0); false si no se puede
+inline bool resetPeakRss() {
+#ifdef __linux__
+    std::FILE* file = std::fopen("/proc/self/clear_refs", "w");
+    if (!file) return false;
+    const bool written = std::fputs("5", file) >= 0;
+    return std::fclose(file) == 0 && written;
+#else
+    return false;
+#endif
+}
+
+// Pico de memoria residente en KB desde el arranque o desde el último
+// resetPeakRss() (0 si no está disponible)
+inline long peakRssKB() {
+    if (long peak = procStatusKB("VmHWM:")) return peak;
+#if defined(__unix__) || defined(__APPLE__)
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) == 0) {
+#ifdef __APPLE__
+        return usage.ru_maxrss / 1024;
+#else
+        return usage.ru_maxrss;
+#endif
+    }
+#endif
+    return 0;
+}
+
+struct BenchmarkResult {
+    std::string name;
+    std::vector<std::pair<std::string, double>> params;
+    int runs = 0;
+    double secondsPerRun = 0.0;
+    double cellsPerRun = 0.0;          // celdas procesadas (o pasos del agente) por ejecución
+    double allocationsPerRun = 0.0;
+    double bytesAllocatedPerRun = 0.0;
+    long peakRssKB = 0;
+    bool peakRssPerCase = false;       // false: pico de todo el proceso
+};
+
+class BenchmarkSuite {
+public:
+    // threads: hilos del pool con que corren los casos (se guarda en el JSON)
+    explicit BenchmarkSuite(int threads, double minSeconds = 0.2) : threads_(threads), minSeconds_(minSeconds) {}
+
+    // setup() prepara la entrada (no se mide); body() es la parte medida.
+    // Se repite hasta acumular minSeconds (al menos una vez)
+    template <class Setup, class Body>
+    void run(const std::string& name, std::vector<std::pair<std::string, double>> params,
+             double cellsPerRun, Setup&& setup, Body&& body) {
+        BenchmarkResult result;
+        result.name = name;
+        result.params = std::move(params);
+        result.cellsPerRun = cellsPerRun;
+        double measured = 0.0;
+        AllocationCounters allocated;
+        result.peakRssPerCase = resetPeakRss();
+        while (result.runs == 0 || measured < minSeconds_) {
+            setup();
+            AllocationCounters before = allocationSnapshot();
+            auto start = std::chrono::steady_clock::now();
+            body();
+            measured += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            AllocationCounters after = allocationSnapshot();
+            allocated.count += after.count - before.count;
+            allocated.bytes += after.bytes - before.bytes;
+            result.runs++;
+        }
+        result.secondsPerRun = measured / result.runs;
+        result.allocationsPerRun = static_cast<double>(allocated.count) / result.runs;
+        result.bytesAllocatedPerRun = static_cast<double>(allocated.bytes) / result.runs;
+        result.peakRssKB = peakRssKB();
+        std::cerr << "  " << name << describe(result.params) << ": " << result.secondsPerRun * 1e3 << " ms, "
+                  << (result.cellsPerRun / result.secondsPerRun) << " cells/s" << std::endl;
+        results_.push_back(std::move(result));
+    }
+
+    void writeJson(std::ostream& out) const {
+        out << "{\n  \"simd\": \"" << simdLevelName(detectSimdLevel()) << "\",\n"
+            << "  \"threads\": " << threads_ << ",\n"
+            << "  \"allocation_counting\": " << (kAllocationCounting ? "true" : "false") << ",\n"
+            << "  \"compiler\": \"" << __VERSION__ << "\",\n"
+            << "  \"results\": [\n";
+        for (size_t k = 0; k < results_.size(); ++k) {
+            const BenchmarkResult& r = results_[k];
+            out << "    {\"name\": \"" << r.name << "\", \"params\": {";
+            for (size_t p = 0; p < r.params.size(); ++p) {
+                out << (p ? ", " : "") << "\"" << r.params[p].first << "\": " << r.params[p].second;
+            }
+            out << "}, \"runs\": " << r.runs
+                << ", \"seconds_per_run\": " << r.secondsPerRun
+                << ", \"cells_per_second\": " << (r.cellsPerRun / r.secondsPerRun)
+                << ", \"allocations_per_run\": ";
+            // Sin -DPCG_ALLOC_COUNTING no se midió nada: null, no un 0 que parezca medido
+            if (kAllocationCounting) {
+                out << r.allocationsPerRun << ", \"bytes_allocated_per_run\": " << r.bytesAllocatedPerRun;
+            } else {
+                out << "null, \"bytes_allocated_per_run\": null";
+            }
+            out << ", \"peak_rss_kb\": " << r.peakRssKB
+                << ", \"peak_rss_scope\": \"" << (r.peakRssPerCase ? "case" : "process") << "\"}"
+                << (k + 1 < results_.size() ? "," : "") << "\n";
+        }
+        out << "  ]\n}\n";
+    }
+
+private:
+    static std::string describe(const std::vector<std::pair<std::string, double>>& params) {
+        std::ostringstream text;
+        for (const auto& param : params) text << " " << param.first << "=" << param.second;
+        return text.str();
+    }
+
+    int threads_;
+    double minSeconds_;
+    std::vector<BenchmarkResult> results_;
+};
+
+// Recorre tamaños de 64^2 hasta maxSize^2 (potencias de 4) y los parámetros de
+// cada etapa. Todo lo que corre en paralelo usa pool, así que se puede medir
+// cómo escala con el número de hilos
+void runBenchmarks(int maxSize, ThreadPool& pool, std::ostream& out) {
+    ScopedLogLevel quiet(LogLevel::Silent);
+    BenchmarkSuite suite(pool.size());
+    std::vector<int> sizes;
+    for (int size = 64; size <= maxSize; size *= 4) sizes.push_back(size);
+
+    std::cerr << "Running benchmarks up to " << maxSize << "x" << maxSize << std::endl;
+    for (int size : sizes) {
+        const double cells = static_cast<double>(size) * size;
+        Grid grid(size, size);
+        // El costo del ruido no depende de la densidad; su resultado es la
+        // entrada de los casos siguientes
+        suite.run("initializeWithNoise", {{"size", size}, {"density", 0.45}}, cells,
+                  [] {}, [&] { initializeWithNoise(grid, 0.45, 42, &pool); });
+        const Grid initial = grid;
+
+        for (int R : {1, 2, 3, 5, 8}) {
+            const int neighborhood = (2 * R + 1) * (2 * R + 1) - 1;
+            for (int U : {neighborhood / 3, neighborhood / 2, neighborhood / 2 + 1}) {
+                for (int iterations : {1, 4}) {
+                    suite.run("cellularAutomata",
+                              {{"size", size}, {"R", R}, {"U", U}, {"iterations", iterations}},
+                              cells * iterations, [&] { grid = initial; },
+                              [&] { cellularAutomata(grid, R, U, iterations); });
+                    // La versión en el lugar es secuencial; se limita a mapas medianos
+                    if (size <= 1024) {
+                        suite.run("cellularAutomataAlternative",
+                                  {{"size", size}, {"R", R}, {"U", U}, {"iterations", iterations}},
+                                  cells * iterations, [&] { grid = initial; },
+                                  [&] { cellularAutomataAlternative(grid, R, U, iterations); });
+                    }
+                }
+            }
+        }
+
+        // Después de que el mapa convergió: un agente excava y se suaviza de nuevo,
+        // con el autómata completo y con el incremental (que solo ve lo excavado)
+        {
+            Grid converged = initial;
+            cellularAutomata(converged, 1, 5, 24);
+            const std::vector<std::pair<std::string, double>> params = {
+                {"size", size}, {"R", 1}, {"U", 5}, {"iterations", 2}};
+            suite.run("agentThenCellularAutomata", params, cells * 2, [&] { grid = converged; }, [&] {
+                enhancedDrunkAgent(grid, 50, 20, 6, 6, 0.2, 0.1, 0.3, 0.08, 7);
+                cellularAutomata(grid, 1, 5, 2);
+            });
+            IncrementalCellularAutomata incremental(pool);
+            DirtyTracker dirty;
+            suite.run("agentThenIncrementalCellularAutomata", params, cells * 2, [&] {
+                grid = converged;
+                dirty.reset(size, size, dirty.tileRows(), dirty.tileCols());
+                incremental.run(grid, 1, 5, 1, dirty);  // deja el estado sucio de un mapa convergido
+            }, [&] {
+                enhancedDrunkAgent(grid, 50, 20, 6, 6, 0.2, 0.1, 0.3, 0.08, 7, WalkMode::FastForward, &dirty);
+                incremental.run(grid, 1, 5, 2, dirty);
+            });
+        }
+
+        for (int J : {100, 1000}) {
+            for (int I : {8, 64}) {
+                for (int room : {3, 16, 64}) {
+                    if (room > size) continue;
+                    const double steps = static_cast<double>(J) * I;
+                    std::vector<std::pair<std::string, double>> params = {
+                        {"size", size}, {"J", J}, {"I", I}, {"room", room}};
+                    suite.run("drunkAgent", params, steps, [&] { grid.clear(); }, [&] {
+                        int agentX = -1, agentY = -1;
+                        drunkAgent(grid, J, I, room, room, 0.2, 0.1, 0.3, 0.08, agentX, agentY, 7);
+                    });
+                    suite.run("enhancedDrunkAgent", params, steps, [&] { grid.clear(); }, [&] {
+                        enhancedDrunkAgent(grid, J, I, room, room, 0.2, 0.1, 0.3, 0.08, 7);
+                    });
+                }
+            }
+        }
+
+        // Relleno y regiones: análisis aparte y fusionado con la última iteración
+        {
+            RegionAnalyzer analyzer;
+            ParallelCellularAutomata engine(pool);
+            Grid converged = initial;
+            cellularAutomata(converged, 1, 4, 4);
+            suite.run("analyzeMap", {{"size", size}, {"threads", pool.size()}}, cells, [] {},
+                      [&] { analyzer.analyze(converged, pool); });
+            suite.run("cellularAutomataParallel", {{"size", size}, {"R", 1}, {"U", 4}, {"iterations", 1}, {"stats", 0}},
+                      cells, [&] { grid = initial; }, [&] { engine.run(grid, 1, 4, 1); });
+            suite.run("cellularAutomataParallel", {{"size", size}, {"R", 1}, {"U", 4}, {"iterations", 1}, {"stats", 1}},
+                      cells, [&] { grid = initial; }, [&] {
+                          engine.run(grid, 1, 4, 1, NeighborCounting::Auto, &analyzer);
+                          analyzer.finish();
+                      });
+        }
+
+        // Autómata de varios estados: la regla binaria (para comparar con
+        // cellularAutomataParallel) y cuatro materiales en una sola pasada
+        {
+            MultiStateCellularAutomata engine(pool);
+            StateGrid binaryStates = StateGrid::fromGrid(initial);
+            StateGrid materialStates(size, size);
+            initializeStates(materialStates, {0.5, 0.4, 0.06, 0.04}, 42, &pool);
+            StateGrid states;
+            for (int R : {1, 2}) {
+                const int U = ((2 * R + 1) * (2 * R + 1) - 1) / 2;
+                const StateRule binary = StateRule::binary(R, U);
+                StateRule materials(4, R, 1);
+                materials.transition(0, 1, U + 1, materials.maxNeighbors(), 1)
+                    .transition(0, 2, U / 2, materials.maxNeighbors(), 2)
+                    .transition(1, 1, 0, U - 1, 0)
+                    .transition(3, 2, 1, materials.maxNeighbors(), 1)
+                    .transition(2, 3, U / 2, materials.maxNeighbors(), 3);
+                suite.run("multiStateCellularAutomata", {{"size", size}, {"states", 2}, {"R", R}, {"iterations", 1}},
+                          cells, [&] { states = binaryStates; }, [&] { engine.run(states, binary, 1); });
+                suite.run("multiStateCellularAutomata", {{"size", size}, {"states", 4}, {"R", R}, {"iterations", 1}},
+                          cells, [&] { states = materialStates; }, [&] { engine.run(states, materials, 1); });
+            }
+        }
+
+        // Cuadro ASCII e imagen PBM en memoria (sin la escritura al archivo)
+        {
+            std::vector<char> frame;
+            suite.run("renderAscii", {{"size", size}}, cells, [] {}, [&] { renderAscii(initial, frame); });
+            suite.run("renderImage", {{"size", size}, {"pbm", 1}}, cells, [] {},
+                      [&] { renderImage(initial, ImageFormat::PBM, frame); });
+        }
+
+        // Varios agentes a la vez en el pool (celdas marcadas por segundo de reloj)
+        for (int K : {8, 64}) {
+            const int J = 1000, I = 64, room = 16;
+            if (room > size) continue;
+            suite.run("multiAgentDrunkWalk",
+                      {{"size", size}, {"K", K}, {"J", J}, {"I", I}, {"room", room},
+                       {"threads", pool.size()}},
+                      static_cast<double>(K) * J * I, [&] { grid.clear(); },
+                      [&] { multiAgentDrunkWalk(grid, K, J, I, room, room, 0.2, 0.1, 0.3, 0.08, 7, &pool); });
+        }
+    }
+    suite.writeJson(out);
+}
+
+// Función para probar diferentes configuraciones del Drunk Agent
+void testDrunkAgentConfigurations(uint64_t seed) {
+    std::cout << "\n=== TESTING DIFFERENT DRUNK AGENT CONFIGURATIONS ===" << std::endl;
+    
+    // Configuración 1: Agente conservador (pocas habitaciones, pocos cambios de dirección)
+    {
+        std::cout << "\n--- Configuration 1: Conservative Agent ---" << std::endl;
+        int W = 20, H = 15;
+        Map map1(H, std::vector<int>(W, 0));
+        
+        std::cout << "Initial empty map:" << std::endl;
+        printMap(map1);
+        
+        map1 = enhancedDrunkAgent(map1, W, H, 6, 8, 3, 3, 0.1, 0.03, 0.15, 0.02, deriveSeed(seed, 1));
+        
+        std::cout << "Final conservative agent map:" << std::endl;
+        printMap(map1);
+        
+        int filled = countFilled(map1);
+        std::cout << "Fill percentage: " << (100.0 * filled / (W * H)) << "%" << std::endl;
+    }
+    
+    // Configuración 2: Agente agresivo (muchas habitaciones, muchos cambios)
+    {
+        std::cout << "\n--- Configuration 2: Aggressive Agent ---" << std::endl;
+        int W = 20, H = 15;
+        Map map2(H, std::vector<int>(W, 0));
+        
+        std::cout << "Initial empty map:" << std::endl;
+        printMap(map2);
+        
+        map2 = enhancedDrunkAgent(map2, W, H, 10, 4, 5, 4, 0.3, 0.15, 0.4, 0.1, deriveSeed(seed, 2));
+        
+        std::cout << "Final aggressive agent map:" << std::endl;
+        printMap(map2);
+        
+        int filled = countFilled(map2);
+        std::cout << "Fill percentage: " << (100.0 * filled / (W * H)) << "%" << std::endl;
+    }
+    
+    // Configuración 3: Agente equilibrado
+    {
+        std::cout << "\n--- Configuration 3: Balanced Agent ---" << std::endl;
+        int W = 20, H = 15;
+        Map map3(H, std::vector<int>(W, 0));
+        
+        std::cout << "Initial empty map:" << std::endl;
+        printMap(map3);
+        
+        map3 = enhancedDrunkAgent(map3, W, H, 8, 6, 4, 3, 0.2, 0.08, 0.25, 0.05, deriveSeed(seed, 3));
+        
+        std::cout << "Final balanced agent map:" << std::endl;
+        printMap(map3);
+        
+        int filled = countFilled(map3);
+        std::cout << "Fill percentage: " << (100.0 * filled / (W * H)) << "%" << std::endl;
+    }
+}
+
+// Función para probar solo el autómata celular con diferentes enfoques
+void testCellularAutomataOnly(uint64_t seed) {
+    std::cout << "\n=== TESTING CELLULAR AUTOMATA ONLY ===" << std::endl;
+    
+    int W = 25, H = 15;
+    Map map = initializeWithNoise(W, H, 0.42, deriveSeed(seed, 1));
+    
+    std::cout << "\nInitial random map:" << std::endl;
+    printMap(map);
+    
+    // Aplicar iteraciones una por una para ver la evolución
+    std::cout << "\n--- Cellular Automata Evolution ---" << std::endl;
+    for (int i = 1; i <= 5; ++i) {
+        map = cellularAutomata(map, W, H, 1, 4, 1); // 1 iteración a la vez
+        
+        std::cout << "\nAfter iteration " << i << ":" << std::endl;
+        printMap(map);
+        
+        // Calcular estadísticas
+        int filled = countFilled(map);
+        std::cout << "Fill percentage: " << (100.0 * filled / (W * H)) << "%" << std::endl;
+    }
+    
+    // Probar con diferentes parámetros
+    std::cout << "\n--- Testing Different Parameters ---" << std::endl;
+    
+    // Prueba con umbral más alto
+    Map map2 = initializeWithNoise(W, H, 0.5, deriveSeed(seed, 2));
+    std::cout << "\nHigh threshold test (U=6):" << std::endl;
+    std::cout << "Initial map:" << std::endl;
+    printMap(map2);
     
-    std::cout << "Initializing map with random noise (density: " << density << ")" << std::endl;
+    map2 = cellularAutomata(map2, W, H, 1, 6, 3);
+    std::cout << "After 3 iterations with U=6:" << std::endl;
+    printMap(map2);
+    
+    // Prueba con umbral más bajo
+    Map map3 = initializeWithNoise(W, H, 0.3, deriveSeed(seed, 3));
+    std::cout << "\nLow threshold test (U=2):" << std::endl;
+    std::cout << "Initial map:" << std::endl;
+    printMap(map3);
     
+    map3 = cellularAutomata(map3, W, H, 1, 2, 3);
+    std::cout << "After 3 iterations with U=2:" << std::endl;
+    printMap(map3);
+}
+
+// Grilla aleatoria reproducible para las pruebas de equivalencia
+Grid makeRandomGrid(int W, int H, Grid::Storage storage, double density, unsigned seed) {
+    Grid grid(W, H, storage);
+    std::mt19937 rng(seed);
+    std::uniform_real_distribution<double> chance(0.0, 1.0);
     for (int i = 0; i < H; ++i) {
         for (int j = 0; j < W; ++j) {
-            if (chance(rng) < density) {
-                map[i][j] = 1;
+            if (chance(rng) < density) grid.set(i, j, 1);
+        }
+    }
+    return grid;
+}
+
+// Función para verificar que el conteo por sumas de caja da el mismo
+// resultado que el conteo directo, para ambas variantes del autómata
+void testNeighborCountingModes() {
+    std::cout << "\n=== TESTING NEIGHBOR COUNTING MODES ===" << std::endl;
+
+    const int sizes[][2] = {{1, 1}, {3, 2}, {25, 15}, {64, 7}, {70, 33}, {130, 41}};
+    const Grid::Storage storages[] = {Grid::Storage::Bits, Grid::Storage::Bytes};
+    int total = 0;
+    int passed = 0;
+    unsigned seed = 1;
+
+    for (const auto& size : sizes) {
+        for (Grid::Storage storage : storages) {
+            for (int R = 1; R <= 8; ++R) {
+                int maxNeighbors = (2 * R + 1) * (2 * R + 1) - 1;
+                for (int U : {0, maxNeighbors / 3, maxNeighbors / 2, maxNeighbors / 2 + 1, maxNeighbors}) {
+                    Grid src = makeRandomGrid(size[0], size[1], storage, 0.45, seed++);
+                    CAScratch scratch;
+
+                    Grid direct(src.width(), src.height(), storage);
+                    Grid boxSum(src.width(), src.height(), storage);
+                    caStep(src, direct, R, U, 0, src.height(), NeighborCounting::Direct, scratch);
+                    caStep(src, boxSum, R, U, 0, src.height(), NeighborCounting::BoxSum, scratch);
+
+                    Grid altDirect = src;
+                    Grid altBoxSum = src;
+                    caAlternativePass(altDirect, R, U, NeighborCounting::Direct, scratch);
+                    caAlternativePass(altBoxSum, R, U, NeighborCounting::BoxSum, scratch);
+
+                    total += 2;
+                    if (direct.sameCells(boxSum)) passed++;
+                    if (altDirect.sameCells(altBoxSum)) passed++;
+                }
             }
         }
     }
-    
-    return map;
+
+    std::cout << "BoxSum vs Direct: " << passed << "/" << total << " configurations identical"
+              << (passed == total ? " [PASS]" : " [FAIL]") << std::endl;
 }
 
-// Autómata celular que NO sobreescribe la grilla original
-// Usa una grilla temporal para calcular todos los cambios antes de aplicarlos
-Map cellularAutomata(const Map& currentMap, int W, int H, int R, int U, int iterations) {
-    Map workMap = currentMap;
-    
-    std::cout << "\n=== Cellular Automata Processing ===" << std::endl;
-    std::cout << "Parameters: R=" << R << ", U=" << U << ", Iterations=" << iterations << std::endl;
-    
-    for (int iter = 0; iter < iterations; ++iter) {
-        std::cout << "CA Iteration " << (iter + 1) << "/" << iterations << std::endl;
-        
-        // Crear una grilla temporal para almacenar los nuevos valores
-        Map tempMap(H, std::vector<int>(W, 0));
-        
-        // Calcular todos los nuevos valores basándose en la grilla actual
-        for (int i = 0; i < H; ++i) {
-            for (int j = 0; j < W; ++j) {
-                int neighbors = 0;
-                
-                // Contar vecinos en un radio cuadrado R
-                for (int di = -R; di <= R; ++di) {
-                    for (int dj = -R; dj <= R; ++dj) {
-                        if (di == 0 && dj == 0) continue; // No contar la celda central
-                        
-                        int ni = i + di;
-                        int nj = j + dj;
-                        
-                        // Manejar bordes - consideramos como 1 (muros)
-                        if (ni < 0 || ni >= H || nj < 0 || nj >= W) {
-                            neighbors++;
-                        } else {
-                            neighbors += workMap[ni][nj]; // Usar la grilla actual, no la temporal
+// Función para verificar el kernel bitboard (R = 1) contra el conteo directo
+// escalar sobre mapas aleatorios, con cada nivel SIMD disponible en esta CPU
+void testBitboardKernel() {
+    std::cout << "\n=== TESTING BITBOARD CA KERNEL (R=1) ===" << std::endl;
+
+    SimdLevel best = detectSimdLevel();
+    std::cout << "Best SIMD level: " << simdLevelName(best) << std::endl;
+
+    const int sizes[][2] = {{1, 1}, {5, 3}, {63, 9}, {64, 64}, {65, 17}, {200, 31}, {513, 12}};
+    const double densities[] = {0.1, 0.45, 0.9};
+    unsigned seed = 1000;
+
+    for (SimdLevel level : {SimdLevel::Scalar, SimdLevel::AVX2, SimdLevel::AVX512}) {
+        if (static_cast<int>(level) > static_cast<int>(best)) continue;
+        int total = 0;
+        int passed = 0;
+        for (const auto& size : sizes) {
+            for (double density : densities) {
+                for (int U = 0; U <= 9; ++U) {
+                    Grid src = makeRandomGrid(size[0], size[1], Grid::Storage::Bits, density, seed++);
+                    CAScratch scratch;
+
+                    Grid expected(src.width(), src.height());
+                    Grid actual(src.width(), src.height());
+                    caStep(src, expected, 1, U, 0, src.height(), NeighborCounting::Direct, scratch);
+                    caStepBitboard(src, actual, U, 0, src.height(), scratch, level);
+
+                    Grid altExpected = src;
+                    Grid altActual = src;
+                    caAlternativePass(altExpected, 1, U, NeighborCounting::Direct, scratch);
+                    caAlternativePassBitboard(altActual, U, scratch, level);
+
+                    total += 2;
+                    if (expected.sameCells(actual)) passed++;
+                    if (altExpected.sameCells(altActual)) passed++;
+                }
+            }
+        }
+        std::cout << "Bitboard (" << simdLevelName(level) << ") vs scalar: " << passed << "/" << total
+                  << " maps identical" << (passed == total ? " [PASS]" : " [FAIL]") << std::endl;
+    }
+}
+
+// Función para verificar los kernels especializados (R y U en compilación)
+// contra el conteo directo, en cada nivel SIMD disponible
+void testSpecializedKernels() {
+    std::cout << "\n=== TESTING SPECIALIZED CA KERNELS (R=1..3) ===" << std::endl;
+    const SimdLevel best = detectSimdLevel();
+    const int sizes[][2] = {{1, 1}, {3, 7}, {63, 9}, {64, 20}, {65, 17}, {200, 31}, {513, 12}};
+    unsigned seed = 5000;
+    for (SimdLevel level : {SimdLevel::Scalar, SimdLevel::AVX2, SimdLevel::AVX512}) {
+        if (static_cast<int>(level) > static_cast<int>(best)) continue;
+        int total = 0;
+        int passed = 0;
+        for (int R = 1; R <= 3; ++R) {
+            const int neighborhood = (2 * R + 1) * (2 * R + 1) - 1;
+            for (int U = 1; U <= neighborhood; ++U) {
+                const RuleKernel kernel = findRuleKernel(R, U, level);
+                if (!kernel) continue;
+                for (const auto& size : sizes) {
+                    for (double density : {0.2, 0.5, 0.8}) {
+                        Grid src = makeRandomGrid(size[0], size[1], Grid::Storage::Bits, density, seed++);
+                        Grid expected(src.width(), src.height());
+                        Grid actual(src.width(), src.height());
+                        CAScratch scratch;
+                        caStep(src, expected, R, U, 0, src.height(), NeighborCounting::Direct, scratch);
+                        // En dos tramos de filas, como lo llaman los motores por bandas
+                        const int split = src.height() / 3;
+                        caStepRule(src, actual, kernel, 0, split, scratch);
+                        caStepRule(src, actual, kernel, split, src.height(), scratch);
+                        total++;
+                        if (expected.sameCells(actual)) passed++;
+                    }
+                }
+            }
+        }
+        std::cout << "Specialized (" << simdLevelName(level) << ") vs direct: " << passed << "/" << total
+                  << " maps identical" << (passed == total ? " [PASS]" : " [FAIL]") << std::endl;
+    }
+
+    // Plantilla directa, incluidos umbrales triviales y reglas fuera del despacho
+    ScopedLogLevel quiet(LogLevel::Silent);
+    bool same = !findRuleKernel(4, 40) && !findRuleKernel(2, 30);
+    auto check = [&](auto run, int R, int U) {
+        for (Grid::Storage storage : {Grid::Storage::Bits, Grid::Storage::Bytes}) {
+            Grid expected = makeRandomGrid(130, 70, storage, 0.45, seed++);
+            Grid actual = expected;
+            cellularAutomata(expected, R, U, 3, NeighborCounting::Direct);
+            run(actual);
+            same = same && expected.sameCells(actual);
+        }
+    };
+    check([](Grid& g) { cellularAutomata<1, 0>(g, 3); }, 1, 0);
+    check([](Grid& g) { cellularAutomata<1, 5>(g, 3); }, 1, 5);
+    check([](Grid& g) { cellularAutomata<1, 9>(g, 3); }, 1, 9);
+    check([](Grid& g) { cellularAutomata<2, 3>(g, 3); }, 2, 3);
+    check([](Grid& g) { cellularAutomata<2, 24>(g, 3); }, 2, 24);
+    check([](Grid& g) { cellularAutomata<3, 24>(g, 3); }, 3, 24);
+    check([](Grid& g) { cellularAutomata<3, 49>(g, 3); }, 3, 49);
+    std::cout << "cellularAutomata<R, U> vs runtime rule: " << (same ? "identical [PASS]" : "mismatch [FAIL]")
+              << std::endl;
+}
+
+// Función para verificar que el autómata paralelo da el mismo resultado que
+// el secuencial con distintos números de hilos
+void testParallelCellularAutomata() {
+    std::cout << "\n=== TESTING PARALLEL CELLULAR AUTOMATA ===" << std::endl;
+
+    const int sizes[][2] = {{25, 15}, {130, 97}, {300, 211}};
+    const int radii[] = {1, 2, 5};
+    unsigned seed = 2000;
+
+    for (int threads : {1, 2, 3, 8}) {
+        ThreadPool pool(threads);
+        ParallelCellularAutomata engine(pool);
+        int total = 0;
+        int passed = 0;
+        for (const auto& size : sizes) {
+            for (Grid::Storage storage : {Grid::Storage::Bits, Grid::Storage::Bytes}) {
+                for (int R : radii) {
+                    int U = ((2 * R + 1) * (2 * R + 1)) / 2;
+                    Grid expected = makeRandomGrid(size[0], size[1], storage, 0.45, seed++);
+                    Grid actual = expected;
+
+                    CAScratch scratch;
+                    Grid next(expected.width(), expected.height(), storage);
+                    for (int iter = 0; iter < 4; ++iter) {
+                        caStep(expected, next, R, U, 0, expected.height(), NeighborCounting::Auto, scratch);
+                        expected.swap(next);
+                    }
+                    engine.run(actual, R, U, 4);
+
+                    total++;
+                    if (expected.sameCells(actual)) passed++;
+                }
+            }
+        }
+        std::cout << "Parallel (" << threads << " threads) vs sequential: " << passed << "/" << total
+                  << " maps identical" << (passed == total ? " [PASS]" : " [FAIL]") << std::endl;
+    }
+}
+
+// Regiones de referencia: búsqueda en anchura desde cada celda sin visitar, en
+// orden fila por fila (la misma numeración que RegionAnalyzer)
+std::vector<RegionInfo> referenceRegions(const Grid& grid, int value) {
+    const int W = grid.width(), H = grid.height();
+    std::vector<uint8_t> seen(static_cast<size_t>(W) * H, 0);
+    std::vector<RegionInfo> regions;
+    std::vector<std::pair<int, int>> queue;
+    for (int i = 0; i < H; ++i) {
+        for (int j = 0; j < W; ++j) {
+            if (grid.get(i, j) != value || seen[static_cast<size_t>(i) * W + j]) continue;
+            RegionInfo region;
+            region.minRow = region.maxRow = i;
+            region.minCol = region.maxCol = j;
+            queue.assign(1, {i, j});
+            seen[static_cast<size_t>(i) * W + j] = 1;
+            for (size_t q = 0; q < queue.size(); ++q) {
+                const int r = queue[q].first, c = queue[q].second;
+                ++region.cells;
+                region.minRow = std::min(region.minRow, r);
+                region.maxRow = std::max(region.maxRow, r);
+                region.minCol = std::min(region.minCol, c);
+                region.maxCol = std::max(region.maxCol, c);
+                const int dr[] = {-1, 1, 0, 0};
+                const int dc[] = {0, 0, -1, 1};
+                for (int d = 0; d < 4; ++d) {
+                    const int nr = r + dr[d], nc = c + dc[d];
+                    if (!grid.inBounds(nr, nc) || grid.get(nr, nc) != value) continue;
+                    if (seen[static_cast<size_t>(nr) * W + nc]) continue;
+                    seen[static_cast<size_t>(nr) * W + nc] = 1;
+                    queue.push_back({nr, nc});
+                }
+            }
+            regions.push_back(region);
+        }
+    }
+    return regions;
+}
+
+inline bool sameRegions(const std::vector<RegionInfo>& a, const std::vector<RegionInfo>& b) {
+    if (a.size() != b.size()) return false;
+    for (size_t r = 0; r < a.size(); ++r) {
+        if (a[r].cells != b[r].cells || a[r].minRow != b[r].minRow || a[r].maxRow != b[r].maxRow ||
+            a[r].minCol != b[r].minCol || a[r].maxCol != b[r].maxCol) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Función para verificar las estadísticas: relleno por popcount y regiones por
+// union-find en bandas contra una búsqueda en anchura, con varios hilos, ambos
+// valores de celda y fusionadas con la última iteración del autómata
+void testMapStats() {
+    std::cout << "\n=== TESTING MAP STATISTICS ===" << std::endl;
+    const int sizes[][2] = {{1, 1}, {70, 5}, {64, 64}, {130, 97}, {301, 211}};
+    unsigned seed = 4000;
+    int passed = 0, total = 0;
+    for (int threads : {1, 3, 8}) {
+        ThreadPool pool(threads);
+        RegionAnalyzer walls(1), floors(0);
+        for (const auto& size : sizes) {
+            for (Grid::Storage storage : {Grid::Storage::Bits, Grid::Storage::Bytes}) {
+                for (double density : {0.3, 0.45, 0.6, 0.75}) {
+                    Grid grid = makeRandomGrid(size[0], size[1], storage, density, seed++);
+                    uint64_t filled = 0;
+                    for (int i = 0; i < grid.height(); ++i) {
+                        for (int j = 0; j < grid.width(); ++j) filled += grid.get(i, j);
+                    }
+                    const MapStats& ones = walls.analyze(grid, pool);
+                    bool same = ones.filled == filled && countFilled(grid) == filled &&
+                                sameRegions(ones.regions, referenceRegions(grid, 1));
+                    same = same && sameRegions(floors.analyze(grid, pool).regions, referenceRegions(grid, 0));
+                    ++total;
+                    if (same) ++passed;
+                }
+            }
+        }
+    }
+    std::cout << "Regions vs flood fill: " << passed << "/" << total << " maps identical "
+              << (passed == total ? "[PASS]" : "[FAIL]") << std::endl;
+
+    // Análisis fusionado con la última iteración vs autómata seguido de análisis
+    passed = total = 0;
+    for (int threads : {1, 4}) {
+        ThreadPool pool(threads);
+        ParallelCellularAutomata engine(pool);
+        RegionAnalyzer analyzer;
+        for (const auto& size : sizes) {
+            for (int iterations : {0, 1, 3}) {
+                Grid expected = makeRandomGrid(size[0], size[1], Grid::Storage::Bits, 0.45, seed++);
+                Grid actual = expected;
+                {
+                    ScopedLogLevel quiet(LogLevel::Silent);
+                    cellularAutomata(expected, 1, 4, iterations);
+                }
+                engine.run(actual, 1, 4, iterations, NeighborCounting::Auto, &analyzer);
+                const MapStats& stats = analyzer.finish();
+                ++total;
+                if (actual.sameCells(expected) && stats.filled == countFilled(expected) &&
+                    sameRegions(stats.regions, referenceRegions(expected, 1))) {
+                    ++passed;
+                }
+            }
+        }
+    }
+    std::cout << "Fused with the last CA iteration: " << passed << "/" << total << " maps identical "
+              << (passed == total ? "[PASS]" : "[FAIL]") << std::endl;
+}
+
+// Paso de referencia del autómata de varios estados: cuenta cada vecindario
+// celda por celda y aplica la tabla en el mismo orden de prioridad
+void referenceStateStep(const StateGrid& src, StateGrid& dst, const StateRule& rule) {
+    const int W = src.width(), H = src.height(), R = rule.radius();
+    for (int i = 0; i < H; ++i) {
+        for (int j = 0; j < W; ++j) {
+            std::array<int, StateRule::kMaxStates> counts{};
+            for (int di = -R; di <= R; ++di) {
+                for (int dj = -R; dj <= R; ++dj) {
+                    if (di == 0 && dj == 0) continue;
+                    const uint8_t neighbor = src.inBounds(i + di, j + dj) ? src.get(i + di, j + dj) : rule.borderState();
+                    if (neighbor < rule.states()) counts[neighbor]++;
+                }
+            }
+            const uint8_t state = src.get(i, j);
+            uint8_t next = state;
+            for (int k = 0; state < rule.states() && k < rule.orderCount(state); ++k) {
+                const uint8_t counted = rule.order(state)[k];
+                if (rule.next(state, counted, counts[counted]) != StateRule::Keep) {
+                    next = rule.next(state, counted, counts[counted]);
+                    break;
+                }
+            }
+            dst.set(i, j, next);
+        }
+    }
+}
+
+// Función para verificar el autómata de varios estados: con la regla binaria
+// coincide con el autómata binario, y con tablas al azar de hasta 8 estados el
+// histograma por ventana, las bandas en paralelo y la referencia celda por celda
+// dan lo mismo
+void testMultiStateCellularAutomata() {
+    std::cout << "\n=== TESTING MULTI-STATE CELLULAR AUTOMATA ===" << std::endl;
+    ScopedLogLevel quiet(LogLevel::Silent);
+
+    ThreadPool pool(3);
+    MultiStateCellularAutomata engine(pool);
+    int total = 0;
+    int passed = 0;
+    unsigned seed = 3100;
+    for (int R : {1, 2, 3, 5}) {
+        const int neighborhood = (2 * R + 1) * (2 * R + 1) - 1;
+        for (int U : {neighborhood / 2, neighborhood / 2 + 1}) {
+            Grid expected = makeRandomGrid(97, 61, Grid::Storage::Bits, 0.45, seed++);
+            StateGrid states = StateGrid::fromGrid(expected);
+            cellularAutomata(expected, R, U, 3);
+            engine.run(states, StateRule::binary(R, U), 3);
+            ++total;
+            if (states.toGrid(1).sameCells(expected)) ++passed;
+        }
+    }
+    std::cout << "Binary rule vs binary CA: " << passed << "/" << total << " maps identical "
+              << (passed == total ? "[PASS]" : "[FAIL]") << std::endl;
+
+    // Tablas al azar: cada entrada es Keep o un estado cualquiera
+    total = passed = 0;
+    const int sizes[][2] = {{1, 1}, {25, 15}, {64, 40}, {131, 77}};
+    for (int states : {3, 5, 8}) {
+        for (int R : {1, 2, 4}) {
+            for (const auto& size : sizes) {
+                CounterRng rng(seed++, RngStage::States, 99);
+                StateRule rule(states, R, static_cast<uint8_t>(rng.nextInt(states + 1)));  // states: sin borde
+                for (int from = 0; from < states; ++from) {
+                    for (int counted = 0; counted < states; ++counted) {
+                        if (rng.nextInt(3) == 0) continue;
+                        for (int n = 0; n <= rule.maxNeighbors(); ++n) {
+                            if (rng.nextInt(3) == 0) rule.set(from, counted, n, static_cast<uint8_t>(rng.nextInt(states)));
                         }
                     }
                 }
-                
-                // Aplicar regla del autómata celular y guardar en grilla temporal
-                if (neighbors >= U) {
-                    tempMap[i][j] = 1;
-                } else {
-                    tempMap[i][j] = 0;
-                }
+                StateGrid expected(size[0], size[1]);
+                initializeStates(expected, std::vector<double>(states, 1.0), seed, nullptr);
+                StateGrid sequential = expected;
+                StateGrid parallel = expected;
+                StateGrid next(size[0], size[1]);
+                for (int iter = 0; iter < 3; ++iter) {
+                    referenceStateStep(expected, next, rule);
+                    expected.swap(next);
+                }
+                cellularAutomata(sequential, rule, 3);
+                engine.run(parallel, rule, 3);
+                ++total;
+                if (sequential.sameCells(expected) && parallel.sameCells(expected)) ++passed;
+            }
+        }
+    }
+    std::cout << "Random lookup tables (3-8 states) vs reference: " << passed << "/" << total
+              << " maps identical " << (passed == total ? "[PASS]" : "[FAIL]") << std::endl;
+
+    // Materiales en una sola pasada: el agua se extiende por el suelo y la lava
+    // se apaga junto al agua; el resultado no depende del número de hilos
+    enum : uint8_t { Floor, Wall, Water, Lava };
+    StateRule materials(4, 1, Wall);
+    materials.transition(Floor, Wall, 5, 8, Wall)
+        .transition(Floor, Water, 3, 8, Water)
+        .transition(Wall, Wall, 0, 3, Floor)
+        .transition(Lava, Water, 1, 8, Wall)
+        .transition(Water, Lava, 4, 8, Lava);
+    StateGrid one(300, 200);
+    initializeStates(one, {0.5, 0.4, 0.06, 0.04}, 7);
+    StateGrid many = one;
+    ThreadPool single(1);
+    MultiStateCellularAutomata oneThread(single);
+    oneThread.run(one, materials, 5);
+    engine.run(many, materials, 5);
+    uint64_t cells = 0;
+    for (uint8_t state : {Floor, Wall, Water, Lava}) cells += one.count(state);
+    const bool ok = one.sameCells(many) && cells == 300u * 200u;
+    std::cout << "Materials map (1 vs 3 threads): floor " << one.count(Floor) << ", wall " << one.count(Wall)
+              << ", water " << one.count(Water) << ", lava " << one.count(Lava)
+              << (ok ? " [PASS]" : " [FAIL]") << std::endl;
+}
+
+// Función para verificar que el bloqueo temporal da el mismo resultado que
+// avanzar una iteración a la vez
+void testTemporalBlocking() {
+    std::cout << "\n=== TESTING TEMPORAL BLOCKING ===" << std::endl;
+
+    ThreadPool pool(3);
+    ParallelCellularAutomata reference(pool);
+    int total = 0;
+    int passed = 0;
+    unsigned seed = 3000;
+
+    for (Grid::Storage storage : {Grid::Storage::Bits, Grid::Storage::Bytes}) {
+        // Baldosas pequeñas para que haya muchos bordes interiores
+        TemporalBlockedCellularAutomata blocked(pool, 37, 64);
+        for (int R : {1, 2, 3}) {
+            for (int k : {1, 2, 3, 5}) {
+                int U = ((2 * R + 1) * (2 * R + 1)) / 2;
+                Grid expected = makeRandomGrid(301, 187, storage, 0.45, seed++);
+                Grid actual = expected;
+                reference.run(expected, R, U, 7);
+                blocked.run(actual, R, U, 7, k);
+
+                total++;
+                if (expected.sameCells(actual)) passed++;
+            }
+        }
+    }
+
+    std::cout << "Temporal blocking vs per-iteration sweep: " << passed << "/" << total
+              << " maps identical" << (passed == total ? " [PASS]" : " [FAIL]") << std::endl;
+}
+
+// Función para verificar que el autómata incremental da el mismo resultado
+// que el completo, con ediciones de los agentes y externas entre llamadas
+void testIncrementalCellularAutomata() {
+    std::cout << "\n=== TESTING INCREMENTAL CELLULAR AUTOMATA ===" << std::endl;
+    ScopedLogLevel quiet(LogLevel::Silent);
+    const int tileShapes[][2] = {{4, 64}, {7, 128}, {32, 256}, {5, 5}};
+    int passed = 0, total = 0;
+    unsigned seed = 500;
+    for (Grid::Storage storage : {Grid::Storage::Bits, Grid::Storage::Bytes}) {
+        for (const auto& shape : tileShapes) {
+            for (int R : {1, 2, 3}) {
+                const int W = 150 + 37 * R, H = 90 + 11 * R;
+                const int U = ((2 * R + 1) * (2 * R + 1) - 1) / 2 + 1;
+                Grid reference = makeRandomGrid(W, H, storage, 0.45, ++seed);
+                Grid grid = reference;
+                DirtyTracker dirty(W, H, shape[0], shape[1]);
+                IncrementalCellularAutomata incremental(inlineThreadPool());
+                bool same = true;
+                for (int round = 0; round < 4; ++round) {
+                    // Cambiar R en la última ronda obliga a reevaluar todo
+                    const int rR = round == 3 ? std::max(1, R - 1) : R;
+                    const int rU = round == 3 ? ((2 * rR + 1) * (2 * rR + 1) - 1) / 2 + 1 : U;
+                    // Suficientes generaciones para que el mapa casi converja y
+                    // queden pocas baldosas sucias
+                    cellularAutomata(reference, rR, rU, 12);
+                    incremental.run(grid, rR, rU, 12, dirty);
+                    same = same && grid.sameCells(reference);
+
+                    enhancedDrunkAgent(reference, 8, 12, 4, 3, 0.2, 0.1, 0.3, 0.08, seed + round);
+                    enhancedDrunkAgent(grid, 8, 12, 4, 3, 0.2, 0.1, 0.3, 0.08, seed + round,
+                                       WalkMode::FastForward, &dirty);
+                    // Edición externa registrada a mano
+                    fillRect(reference, 10 * round, 20, 10 * round + 2, 40);
+                    fillRect(grid, 10 * round, 20, 10 * round + 2, 40);
+                    dirty.markRect(10 * round, 20, 10 * round + 2, 40);
+                }
+                ++total;
+                if (same) ++passed;
+            }
+        }
+    }
+    std::cout << "Incremental vs full CA: " << passed << "/" << total << " scenarios identical "
+              << (passed == total ? "[PASS]" : "[FAIL]") << std::endl;
+}
+
+// Benchmark: barrido por iteración vs bloqueo temporal con distintos k
+void benchmarkTemporalBlocking(int size, int R, int U, int iterations) {
+    std::cout << "\n=== BENCHMARK: TEMPORAL BLOCKING ===" << std::endl;
+    std::cout << "Map: " << size << "x" << size << ", R=" << R << ", U=" << U
+              << ", Iterations=" << iterations << ", Threads=" << defaultThreadPool().size() << std::endl;
+
+    Grid initial = makeRandomGrid(size, size, Grid::Storage::Bits, 0.45, 42);
+    auto timeMs = [](auto&& fn) {
+        auto start = std::chrono::steady_clock::now();
+        fn();
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    };
+
+    Grid expected = initial;
+    ParallelCellularAutomata sweep;
+    double baseline = timeMs([&] { sweep.run(expected, R, U, iterations); });
+    std::cout << "Per-iteration sweep: " << baseline << " ms" << std::endl;
+
+    TemporalBlockedCellularAutomata blocked;
+    for (int k : {1, 2, 4, 8}) {
+        if (k > iterations) break;
+        Grid actual = initial;
+        double elapsed = timeMs([&] { blocked.run(actual, R, U, iterations, k); });
+        std::cout << "Temporal blocking k=" << k << ": " << elapsed << " ms (speedup x"
+                  << (baseline / elapsed) << ")" << (expected.sameCells(actual) ? "" : " [MISMATCH]")
+                  << std::endl;
+    }
+}
+
+// Función para verificar el generador basado en contador y la reproducibilidad por semilla
+void testSeedReproducibility() {
+    std::cout << "\n=== TESTING SEEDED REPRODUCIBILITY ===" << std::endl;
+    int total = 0;
+    int passed = 0;
+    auto check = [&](bool ok, const char* what) {
+        total++;
+        if (ok) passed++;
+        else std::cout << "  failed: " << what << std::endl;
+    };
+
+    // Vectores de referencia de Philox4x32-10 (Random123)
+    CounterRng::Block zero = CounterRng::philox({0u, 0u}, 0, 0);
+    check(zero == CounterRng::Block{0x6627e8d5u, 0xe169c58du, 0xbc57ac4cu, 0x9b00dbd8u}, "philox zero vector");
+    CounterRng::Block ones = CounterRng::philox({0xffffffffu, 0xffffffffu}, ~uint64_t(0), ~uint64_t(0));
+    check(ones == CounterRng::Block{0x408f276du, 0x41c83b0eu, 0xa20bc7c6u, 0x6d5451fdu}, "philox ones vector");
+
+    // Acceso aleatorio: el bloque n coincide con la secuencia
+    CounterRng sequential(7, RngStage::Noise, 3);
+    CounterRng::Block third = CounterRng(7, RngStage::Noise, 3).block(2);
+    for (int k = 0; k < 8; ++k) sequential.nextU32();
+    bool same = true;
+    for (int k = 0; k < 4; ++k) same = same && sequential.nextU32() == third[k];
+    check(same, "random access matches sequence");
+
+    // drawn() cuenta desde la posición inicial, también si no es 0
+    CounterRng offset(7, RngStage::Noise, 3, 5);
+    bool counted = offset.drawn() == 0;
+    offset.nextU32();
+    counted = counted && offset.drawn() == 1;
+    for (int k = 0; k < 5; ++k) offset.nextU32();
+    counted = counted && offset.drawn() == 6 && offset.nextU32() == CounterRng(7, RngStage::Noise, 3).block(6)[2];
+    check(counted, "drawn() counts from the start position");
+
+    // Misma semilla -> mismo mapa; otra semilla -> otro mapa
+    ScopedLogLevel quiet(LogLevel::Silent);
+    auto generate = [](uint64_t seed) {
+        Grid grid(97, 61);
+        initializeWithNoise(grid, 0.45, seed);
+        cellularAutomata(grid, 1, 4, 2);
+        enhancedDrunkAgent(grid, 20, 6, 4, 3, 0.2, 0.1, 0.3, 0.08, deriveSeed(seed, 1));
+        int agentX = -1, agentY = -1;
+        drunkAgent(grid, 20, 6, 4, 3, 0.2, 0.1, 0.3, 0.08, agentX, agentY, deriveSeed(seed, 2));
+        return grid;
+    };
+    Grid first = generate(12345);
+    Grid again = generate(12345);
+    Grid other = generate(54321);
+    check(first.sameCells(again), "same seed reproduces map");
+    check(!first.sameCells(other), "different seed changes map");
+
+    std::cout << "Seeded generation: " << passed << "/" << total << " checks"
+              << (passed == total ? " [PASS]" : " [FAIL]") << std::endl;
+}
+
+// Función para verificar el llenado rápido de ruido: coincide con la definición
+// celda a celda, y no depende del número de hilos, del almacenamiento ni del nivel SIMD
+void testNoiseFill() {
+    std::cout << "\n=== TESTING FAST NOISE FILL ===" << std::endl;
+    int total = 0;
+    int passed = 0;
+    auto check = [&](bool ok, const char* what) {
+        total++;
+        if (ok) passed++;
+        else std::cout << "  failed: " << what << std::endl;
+    };
+
+    const uint64_t seed = 777;
+    const double density = 0.45;
+    const int W = 203, H = 150;
+    ThreadPool pool(3);
+    ScopedLogLevel quiet(LogLevel::Silent);
+    Grid serial(W, H);
+    Grid parallel(W, H);
+    Grid bytes(W, H, Grid::Storage::Bytes);
+    initializeWithNoise(serial, density, seed, nullptr);
+    initializeWithNoise(parallel, density, seed, &pool);
+    initializeWithNoise(bytes, density, seed, &pool);
+
+    // Definición: celda (i, j) = (valor j del flujo de la fila i) < umbral
+    const uint64_t threshold = noiseThreshold(density);
+    bool matches = true;
+    int filled = 0;
+    for (int i = 0; i < H; ++i) {
+        CounterRng rng(seed, RngStage::Noise, static_cast<uint64_t>(i));
+        for (int j = 0; j < W; ++j) {
+            int expected = rng.nextU32() < threshold ? 1 : 0;
+            matches = matches && serial.get(i, j) == expected;
+            filled += expected;
+        }
+    }
+    check(matches, "fast fill matches per-cell definition");
+    check(serial.sameCells(parallel), "result independent of thread count");
+    check(serial.sameCells(bytes), "result independent of storage");
+    double fill = static_cast<double>(filled) / (W * H);
+    check(fill > density - 0.02 && fill < density + 0.02, "fill close to density");
+
+    SimdLevel best = detectSimdLevel();
+    CounterRng rng(seed, RngStage::Noise, 9);
+    std::vector<uint64_t> reference(37);
+    noiseWordsFunction(SimdLevel::Scalar)(rng.key(), rng.stream(), 5, reference.size(), threshold, reference.data());
+    for (SimdLevel level : {SimdLevel::AVX2, SimdLevel::AVX512}) {
+        if (static_cast<int>(level) > static_cast<int>(best)) continue;
+        std::vector<uint64_t> words(reference.size());
+        noiseWordsFunction(level)(rng.key(), rng.stream(), 5, words.size(), threshold, words.data());
+        check(words == reference, simdLevelName(level));
+    }
+
+    std::cout << "Fast noise fill: " << passed << "/" << total << " checks"
+              << (passed == total ? " [PASS]" : " [FAIL]") << std::endl;
+}
+
+// Función para verificar que cada trabajo de un lote da el mismo mapa sin
+// importar el número de hilos, y que coincide con el pipeline de main()
+void testBatchGeneration() {
+    std::cout << "\n=== TESTING BATCH GENERATION ===" << std::endl;
+
+    std::vector<MapJob> jobs(24);
+    for (int k = 0; k < static_cast<int>(jobs.size()); ++k) {
+        jobs[k].seed = deriveSeed(99, k);
+        jobs[k].params.width = 40 + 7 * (k % 5);   // tamaños distintos para desbalancear
+        jobs[k].params.height = 30 + 11 * (k % 3);
+        jobs[k].params.agentJ = 10 + k;
+    }
+
+    auto checksums = [&](int threads) {
+        WorkStealingPool pool(threads);
+        std::vector<uint64_t> sums(jobs.size());
+        runBatch(jobs, pool, [&](int job, const Grid& grid) { sums[job] = gridChecksum(grid); });
+        return sums;
+    };
+    std::vector<uint64_t> one = checksums(1);
+    std::vector<uint64_t> three = checksums(3);
+    std::vector<uint64_t> eight = checksums(8);
+
+    // El trabajo 0 generado a mano con las mismas llamadas que main()
+    Grid expected(jobs[0].params.width, jobs[0].params.height);
+    {
+        ScopedLogLevel quiet(LogLevel::Silent);
+        const GenerationParams& p = jobs[0].params;
+        initializeWithNoise(expected, p.noiseDensity, jobs[0].seed);
+        for (int iteration = 0; iteration < p.outerIterations; ++iteration) {
+            cellularAutomata(expected, p.caR, p.caU, p.caIterations);
+            enhancedDrunkAgent(expected, p.agentJ, p.agentI, p.roomSizeX, p.roomSizeY,
+                               p.A, p.B, p.C, p.D, deriveSeed(jobs[0].seed, iteration));
+        }
+    }
+
+    bool ok = one == three && one == eight && one[0] == gridChecksum(expected);
+    std::cout << "Batch of " << jobs.size() << " jobs with 1/3/8 threads: "
+              << (ok ? "identical per job [PASS]" : "mismatch [FAIL]") << std::endl;
+}
+
+// Función para verificar el pipeline sobre la arena: run() da el mismo mapa que
+// generateMap, una cadena de etapas el mismo que las funciones sobre Map, y una
+// vez caliente ninguna etapa reserva memoria
+void testPipelineArena() {
+    std::cout << "\n=== TESTING PIPELINE ARENA ===" << std::endl;
+    ScopedLogLevel quiet(LogLevel::Silent);
+
+    ThreadPool pool(3);
+    MapPipeline pipeline(pool);
+    GenerationWorkspace workspace;
+    bool sameJobs = true;
+    for (int k = 0; k < 6; ++k) {
+        MapJob job;
+        job.seed = deriveSeed(31, k);
+        job.params.width = 40 + 9 * k;
+        job.params.height = 30 + 5 * (k % 3);
+        pipeline.run(job);
+        generateMap(job, workspace);
+        sameJobs = sameJobs && pipeline.grid().sameCells(workspace.grid);
+    }
+    std::cout << "run() vs generateMap on 6 jobs: " << (sameJobs ? "identical [PASS]" : "mismatch [FAIL]")
+              << std::endl;
+
+    // Cadena de etapas contra las versiones sobre Map
+    const int W = 64, H = 48;
+    const uint64_t seed = 1234;
+    Map expected = initializeWithNoise(W, H, 0.45, seed);
+    int agentX = -1, agentY = -1;
+    expected = cellularAutomata(expected, W, H, 2, 13, 3);
+    expected = drunkAgent(expected, W, H, 8, 5, 3, 3, 0.2, 0.1, 0.3, 0.08, agentX, agentY, deriveSeed(seed, 0));
+    expected = enhancedDrunkAgent(expected, W, H, 6, 4, 3, 3, 0.2, 0.1, 0.3, 0.08, deriveSeed(seed, 1));
+    expected = cellularAutomata(expected, W, H, 1, 4, 2);
+    auto chain = [&] {
+        pipeline.reset(W, H)
+            .noise(0.45, seed)
+            .cellularAutomata(2, 13, 3)
+            .drunkAgent(8, 5, 3, 3, 0.2, 0.1, 0.3, 0.08, deriveSeed(seed, 0))
+            .enhancedDrunkAgent(6, 4, 3, 3, 0.2, 0.1, 0.3, 0.08, deriveSeed(seed, 1))
+            .cellularAutomata(1, 4, 2);
+        return pipeline.analyze().filled;
+    };
+    chain();
+    const bool sameChain = pipeline.grid().sameCells(Grid::fromMap(expected, W, H));
+    std::cout << "Stage chain vs Map functions: " << (sameChain ? "identical [PASS]" : "mismatch [FAIL]")
+              << std::endl;
+
+#ifdef PCG_ALLOC_COUNTING
+    // La cadena ya corrió una vez con este tamaño: las siguientes no reservan.
+    // El perfilador (si se pidió por línea de comandos) sí puede reservar al
+    // guardar eventos, así que se pausa mientras se mide
+    const bool profiling = Profiler::enabled();
+    Profiler::enable(false);
+    pipeline.resetProcessAllocationCount();
+    uint64_t filled = 0;
+    for (int k = 0; k < 3; ++k) filled += chain();
+    const bool zero = pipeline.processAllocations() == 0 && filled == 3 * static_cast<uint64_t>(countFilled(expected));
+    std::cout << "Warm stage chain allocations: " << pipeline.processAllocations()
+              << (zero ? " [PASS]" : " [FAIL]") << std::endl;
+
+    // cellularAutomata(Grid&) reutiliza los buffers del hilo entre llamadas
+    Grid single = pipeline.grid();
+    cellularAutomata(single, 2, 13, 3);
+    const AllocationCounters before = allocationSnapshot();
+    cellularAutomata(single, 2, 13, 3);
+    cellularAutomata(single, 1, 4, 2);
+    const uint64_t repeated = allocationSnapshot().count - before.count;
+    Profiler::enable(profiling);
+    std::cout << "Repeated cellularAutomata allocations: " << repeated << (repeated == 0 ? " [PASS]" : " [FAIL]")
+              << std::endl;
+#else
+    std::cout << "Warm stage chain allocations: not counted (build with -DPCG_ALLOC_COUNTING)" << std::endl;
+#endif
+    std::cout << "Arena buffers in use: " << pipeline.arena().inUse() << "/" << pipeline.arena().capacity()
+              << (pipeline.arena().inUse() == 2 ? " [PASS]" : " [FAIL]") << std::endl;
+
+    // Sin reset(): las etapas trabajan sobre un mapa vacío en vez de indexar fuera de la arena
+    MapPipeline fresh(pool);
+    fresh.noise(0.45, 1).cellularAutomata(1, 4, 2).enhancedDrunkAgent(6, 4, 3, 3, 0.2, 0.1, 0.3, 0.08, 2);
+    const bool empty = fresh.grid().width() == 0 && fresh.analyze().filled == 0 && fresh.arena().inUse() == 2;
+    std::cout << "Stages before reset(): " << (empty ? "empty map [PASS]" : "mismatch [FAIL]") << std::endl;
+}
+
+// Función para verificar el perfilado: los contadores combinados de todos los
+// hilos coinciden con lo que se sabe de antemano (celdas, números aleatorios,
+// habitaciones, choques con el borde), cada ámbito deja un evento, y apagado no
+// cuenta nada. Compara diferencias entre informes, así que no borra un perfil
+// pedido por línea de comandos
+void testProfiler() {
+    std::cout << "\n=== TESTING PROFILER ===" << std::endl;
+#if PCG_PROFILE
+    ScopedLogLevel quiet(LogLevel::Silent);
+    Profiler& profiler = Profiler::instance();
+    const bool wasEnabled = profiler.enabled();
+    const bool wasRecording = profiler.recordingEvents();
+    auto calls = [](const ProfileReport& report, const char* name) {
+        const ProfileZoneStats* zone = report.zone(name);
+        return zone ? zone->calls : 0;
+    };
+    auto events = [](const ProfileReport& report) {
+        size_t total = 0;
+        for (const auto& thread : report.events) total += thread.events.size();
+        return total;
+    };
+    auto delta = [](const ProfileReport& after, const ProfileReport& before, ProfileCounter c) {
+        return after.counter(c) - before.counter(c);
+    };
+
+    const int W = 200, H = 150;
+    const int J = 30, I = 8;
+    ThreadPool pool(3);
+    MapPipeline pipeline(pool);
+    profiler.enable(true);
+    profiler.recordEvents(true);
+    const ProfileReport before = profiler.report();
+    pipeline.reset(W, H).noise(0.45, 77).cellularAutomata(1, 4, 2);
+    Grid carved = pipeline.grid();
+    pipeline.enhancedDrunkAgent(J, I, 4, 4, 0.2, 0.1, 0.3, 0.08, 5);
+    // En un mapa de 5x5 con pasos de 50, cada fase termina contra el borde
+    pipeline.reset(5, 5).enhancedDrunkAgent(12, 50, 1, 1, 0.0, 0.0, 0.3, 0.08, 6);
+    const ProfileReport after = profiler.report();
+
+    // Apagado: el mismo trabajo no cambia nada
+    profiler.enable(false);
+    pipeline.reset(W, H).noise(0.45, 77).cellularAutomata(1, 4, 2);
+    const ProfileReport disabled = profiler.report();
+    profiler.enable(wasEnabled);
+    profiler.recordEvents(wasRecording);
+
+    // El mismo recorrido, contado a mano
+    RoomCountingMarker marker{GridMarker{carved, nullptr}};
+    CounterRng rng(5, RngStage::EnhancedDrunkAgent, 0);
+    CounterRng small(6, RngStage::EnhancedDrunkAgent, 0);
+    {
+        ScopedLogLevel silent(LogLevel::Silent);
+        enhancedDrunkWalk(marker, W, H, J, I, 4, 4, 0.2, 0.1, 0.3, 0.08, rng);
+        GridMarker smallMarker{carved, nullptr};
+        enhancedDrunkWalk(smallMarker, 5, 5, 12, 50, 1, 1, 0.0, 0.0, 0.3, 0.08, small);
+    }
+    const uint64_t cells = static_cast<uint64_t>(W) * H;
+    const uint64_t noiseDraws = static_cast<uint64_t>(H) * ((W + 63) / 64) * 64;
+    bool ok = delta(after, before, ProfileCounter::CellsProcessed) == 3 * cells &&
+              delta(after, before, ProfileCounter::RngDraws) == noiseDraws + rng.drawn() + small.drawn() &&
+              delta(after, before, ProfileCounter::RoomsGenerated) == static_cast<uint64_t>(marker.rooms) &&
+              delta(after, before, ProfileCounter::BoundaryHits) >= 12;
+    std::cout << "Counters (cells " << delta(after, before, ProfileCounter::CellsProcessed) << ", rng draws "
+              << delta(after, before, ProfileCounter::RngDraws) << ", rooms "
+              << delta(after, before, ProfileCounter::RoomsGenerated) << ", boundary hits "
+              << delta(after, before, ProfileCounter::BoundaryHits) << "): "
+              << (ok ? "match [PASS]" : "mismatch [FAIL]") << std::endl;
+
+    uint64_t scopes = 0;
+    for (const ProfileZoneStats& zone : after.zones) scopes += zone.calls - calls(before, zone.name);
+    ok = calls(after, "noise") - calls(before, "noise") == 1 &&
+         calls(after, "cellular_automata") - calls(before, "cellular_automata") == 1 &&
+         calls(after, "agent_walk") - calls(before, "agent_walk") == 2 &&
+         calls(after, "room_stamp") - calls(before, "room_stamp") == static_cast<uint64_t>(marker.rooms) &&
+         events(after) - events(before) == scopes && after.droppedEvents == 0;
+    std::cout << "Scoped timers (" << scopes << " scopes): " << (ok ? "one event each [PASS]" : "mismatch [FAIL]")
+              << std::endl;
+
+    ok = disabled.counters == after.counters && events(disabled) == events(after);
+    std::cout << "Disabled profiler: " << (ok ? "no counts [PASS]" : "counted [FAIL]") << std::endl;
+
+    std::ostringstream json, trace;
+    after.writeJson(json);
+    after.writeChromeTrace(trace);
+    const std::string traceText = trace.str();
+    size_t completeEvents = 0;
+    for (size_t at = traceText.find("\"ph\": \"X\""); at != std::string::npos;
+         at = traceText.find("\"ph\": \"X\"", at + 1)) {
+        ++completeEvents;
+    }
+    ok = json.str().find("\"rooms_generated\": ") != std::string::npos &&
+         traceText.find("{\"displayTimeUnit\"") == 0 && completeEvents == events(after);
+    std::cout << "JSON and Chrome trace export: " << (ok ? "well formed [PASS]" : "malformed [FAIL]") << std::endl;
+#else
+    std::cout << "Profiling compiled out (PCG_PROFILE=0), skipped" << std::endl;
+#endif
+}
+
+// Función para verificar la búsqueda de parámetros: el top-k no depende del
+// número de hilos y, con solo las cotas exactas (por defecto), abandonar
+// candidatos antes de tiempo da el mismo resultado que evaluarlos todos completos
+void testParameterSearch() {
+    std::cout << "\n=== TESTING PARAMETER SEARCH ===" << std::endl;
+    ScopedLogLevel quiet(LogLevel::Silent);
+    GenerationParams base;
+    SearchSpace space;
+    const std::vector<MapJob> candidates = gridCandidates(base, space, 77);
+    SearchTargets targets;
+    targets.minRooms = 3;
+    targets.maxRooms = 6;
+    const int topK = 6;
+
+    // Referencia: cada candidato generado completo y filtrado al final
+    std::vector<SearchCandidate> expected;
+    GenerationWorkspace workspace;
+    for (size_t k = 0; k < candidates.size(); ++k) {
+        int rooms = 0;
+        generateMapChecked(candidates[k], workspace, [&](int, const Grid&, int r) {
+            rooms = r;
+            return true;
+        });
+        const MapStats stats = analyzeMap(workspace.grid, inlineThreadPool());
+        SearchCandidate c;
+        c.index = static_cast<int>(k);
+        c.fill = stats.fillPercentage();
+        c.rooms = rooms;
+        c.connectivity = stats.filled > 0 ? static_cast<double>(stats.largestRegion()) / stats.filled : 0.0;
+        if (c.fill < targets.minFill || c.fill > targets.maxFill || rooms < targets.minRooms ||
+            rooms > targets.maxRooms || c.connectivity < targets.minConnectivity) {
+            continue;
+        }
+        c.score = c.connectivity - std::abs(c.fill - targets.targetFill) / 100.0;
+        expected.push_back(c);
+    }
+    const int accepted = static_cast<int>(expected.size());
+    std::sort(expected.begin(), expected.end(), betterCandidate);
+    if (static_cast<int>(expected.size()) > topK) expected.resize(topK);
+
+    bool same = true;
+    int aborted = 0;
+    for (int threads : {1, 3}) {
+        WorkStealingPool pool(threads);
+        SearchResult result = searchParameters(candidates, targets, topK, pool);
+        same = same && result.accepted == accepted && result.best.size() == expected.size() &&
+               result.accepted + result.rejected + result.aborted == result.candidates;
+        for (size_t r = 0; same && r < expected.size(); ++r) {
+            same = result.best[r].index == expected[r].index && result.best[r].score == expected[r].score &&
+                   result.best[r].rooms == expected[r].rooms;
+        }
+        aborted = result.aborted;
+    }
+    std::cout << "Top-" << topK << " of " << candidates.size() << " candidates (" << accepted << " accepted, "
+              << aborted << " aborted early) vs full evaluation: "
+              << (same && aborted > 0 && accepted > 0 ? "identical [PASS]" : "mismatch [FAIL]") << std::endl;
+
+    // Una lista vacía deja el valor de la base en vez de dividir por cero
+    SearchSpace partial;
+    partial.A.clear();
+    partial.roomSize.clear();
+    bool kept = partial.combinations() == space.combinations() / (space.A.size() * space.roomSize.size());
+    for (const MapJob& job : randomCandidates(base, partial, 50, 5)) {
+        kept = kept && job.params.A == base.A && job.params.roomSizeX == base.roomSizeX &&
+               job.params.roomSizeY == base.roomSizeY;
+    }
+    std::cout << "Empty value lists: " << (kept ? "base values kept [PASS]" : "mismatch [FAIL]") << std::endl;
+}
+
+// Función para verificar que la generación por trozos reproduce el mapa completo
+// (ruido + autómata), con acceso aleatorio, expulsiones y con o sin archivo
+void testChunkedMap() {
+    std::cout << "\n=== TESTING CHUNKED GENERATION ===" << std::endl;
+    ScopedLogLevel quiet(LogLevel::Silent);
+    const int W = 700, H = 450;
+    const int configs[][3] = {{1, 4, 3}, {2, 12, 2}, {1, 5, 0}};
+    std::string path;
+#ifdef PCG_HAS_MMAP
+    const char* tmp = std::getenv("TMPDIR");
+    path = std::string(tmp ? tmp : "/tmp") + "/pcg_chunked_test.bin";
+#endif
+    int passed = 0, total = 0;
+    std::mt19937 order(3);
+    for (const auto& config : configs) {
+        Grid reference(W, H);
+        initializeWithNoise(reference, 0.45, 1234, nullptr);
+        cellularAutomata(reference, config[0], config[1], config[2]);
+
+        for (bool useFile : {false, true}) {
+            if (useFile && path.empty()) continue;
+            ChunkedMapParams params;
+            params.width = W;
+            params.height = H;
+            params.chunkSize = 128;
+            params.caR = config[0];
+            params.caU = config[1];
+            params.caIterations = config[2];
+            params.seed = 1234;
+            params.maxResidentChunks = 3;
+            if (useFile) params.backingFile = path;
+            ChunkedMap chunked(params);
+
+            // Trozos en orden aleatorio (fuerza expulsiones) y luego en streaming
+            std::vector<std::pair<int, int>> chunks;
+            for (int cy = 0; cy < chunked.chunksY(); ++cy) {
+                for (int cx = 0; cx < chunked.chunksX(); ++cx) chunks.push_back({cy, cx});
+            }
+            std::shuffle(chunks.begin(), chunks.end(), order);
+            bool same = !useFile || chunked.fileBacked();
+            for (const auto& c : chunks) {
+                for (int i = c.first * 128; i < std::min(H, (c.first + 1) * 128); ++i) {
+                    for (int j = c.second * 128; j < std::min(W, (c.second + 1) * 128); ++j) {
+                        same = same && chunked.get(i, j) == reference.get(i, j);
+                    }
+                }
             }
+            chunked.forEachChunk([&](const ChunkView& view) {
+                for (int i = 0; i < view.height; ++i) {
+                    for (int j = 0; j < view.width; ++j) {
+                        same = same && view.get(i, j) == reference.get(view.row0 + i, view.col0 + j);
+                    }
+                }
+            });
+            same = same && chunked.residentChunks() <= 3;
+            ++total;
+            if (same) ++passed;
         }
-        
-        // Copiar todos los cambios de la grilla temporal a la grilla de trabajo
-        workMap = tempMap;
     }
-    
-    std::cout << "Cellular Automata processing completed" << std::endl;
-    return workMap;
+    if (!path.empty()) std::remove(path.c_str());
+    std::cout << "Chunked vs full map: " << passed << "/" << total << " configurations identical "
+              << (passed == total ? "[PASS]" : "[FAIL]") << std::endl;
 }
 
-// Implementación alternativa del autómata celular que procesa de izquierda a derecha
-// evitando conflictos al procesar secuencialmente
-Map cellularAutomataAlternative(const Map& currentMap, int W, int H, int R, int U, int iterations) {
-    Map workMap = currentMap;
-    std::cout << "\n=== Alternative Cellular Automata (In-Place Processing) ===" << std::endl;
-    std::cout << "Parameters: R=" << R << ", U=" << U << ", Iterations=" << iterations << std::endl;
-    
-    for (int iter = 0; iter < iterations; ++iter) {
-        std::cout << "CA Alternative Iteration " << (iter + 1) << "/" << iterations << std::endl;
-        
-        // Procesar secuencialmente pero almacenar cambios en variables temporales
-        // para aplicarlos después de calcular cada fila
-        std::vector<int> rowChanges(W);
-        
-        for (int i = 0; i < H; ++i) {
-            // Calcular todos los cambios para esta fila
-            for (int j = 0; j < W; ++j) {
-                int neighbors = 0;
-                
-                // Contar vecinos en un radio cuadrado R
-                for (int di = -R; di <= R; ++di) {
-                    for (int dj = -R; dj <= R; ++dj) {
-                        if (di == 0 && dj == 0) continue; // No contar la celda central
-                        
-                        int ni = i + di;
-                        int nj = j + dj;
-                        
-                        // Manejar bordes - consideramos como 1 (muros)
-                        if (ni < 0 || ni >= H || nj < 0 || nj >= W) {
-                            neighbors++;
-                        } else {
-                            neighbors += workMap[ni][nj];
+// Función para verificar que el formato binario conserva el mapa (Raw y RLE,
+// ambos almacenamientos) y que detecta archivos truncados o corruptos
+void testMapFile() {
+    std::cout << "\n=== TESTING MAP FILE FORMAT ===" << std::endl;
+    ScopedLogLevel quiet(LogLevel::Silent);
+    const char* tmp = std::getenv("TMPDIR");
+    const std::string path = std::string(tmp ? tmp : "/tmp") + "/pcg_map_test.pcgm";
+    const int sizes[][2] = {{1, 1}, {25, 15}, {64, 3}, {65, 70}, {300, 129}};
+    int passed = 0, total = 0;
+    for (const auto& size : sizes) {
+        for (double density : {0.0, 0.45, 1.0}) {
+            for (MapEncoding encoding : {MapEncoding::Raw, MapEncoding::RLE}) {
+                for (Grid::Storage storage : {Grid::Storage::Bits, Grid::Storage::Bytes}) {
+                    Grid grid(size[0], size[1], storage);
+                    initializeWithNoise(grid, density, deriveSeed(55, size[0] * 7 + size[1]), nullptr);
+                    GenerationParams params;
+                    params.width = size[0];
+                    params.height = size[1];
+                    params.noiseDensity = density;
+                    Grid loaded;
+                    MapFileHeader header{};
+                    bool ok = writeMapFile(path, grid, 99, params, encoding) && readMapFile(path, loaded, &header);
+                    ok = ok && loaded.width() == grid.width() && loaded.height() == grid.height() &&
+                         header.seed == 99 && header.noiseDensity == density;
+                    for (int i = 0; ok && i < grid.height(); ++i) {
+                        for (int j = 0; j < grid.width(); ++j) ok = ok && loaded.get(i, j) == grid.get(i, j);
+                    }
+                    if (ok && encoding == MapEncoding::Raw) {
+                        MappedMapFile file;
+                        ok = file.open(path);
+                        for (int i = 0; ok && i < grid.height(); ++i) {
+                            for (int j = 0; j < grid.width(); ++j) ok = ok && file.get(i, j) == grid.get(i, j);
                         }
                     }
+                    ++total;
+                    if (ok) ++passed;
                 }
-                
-                // Calcular nuevo valor
-                if (neighbors >= U) {
-                    rowChanges[j] = 1;
-                } else {
-                    rowChanges[j] = 0;
-                }
-            }
-            
-            // Aplicar todos los cambios de la fila al mismo tiempo
-            for (int j = 0; j < W; ++j) {
-                workMap[i][j] = rowChanges[j];
             }
         }
     }
-    
-    std::cout << "Alternative Cellular Automata processing completed" << std::endl;
-    return workMap;
-}
-
-Map drunkAgent(const Map& currentMap, int W, int H, int J, int I, int roomSizeX, int roomSizeY,
-               double probGenerateRoom, double probIncreaseRoom,
-               double probChangeDirection, double probIncreaseChange,
-               int& agentX, int& agentY) {
 
-    Map newMap = currentMap;
-    std::mt19937 rng(std::chrono::steady_clock::now().time_since_epoch().count());
-    std::uniform_real_distribution<double> chance(0.0, 1.0);
-    std::uniform_int_distribution<int> dirDist(0, 3);
-    
-    // Posición inicial aleatoria si es la primera vez
-    if (agentX == -1 || agentY == -1) {
-        std::uniform_int_distribution<int> xDist(0, H - 1);
-        std::uniform_int_distribution<int> yDist(0, W - 1);
-        agentX = xDist(rng);
-        agentY = yDist(rng);
+    // Un bit cambiado en la carga útil o un archivo truncado deben rechazarse
+    Grid grid(97, 61);
+    initializeWithNoise(grid, 0.45, 8, nullptr);
+    bool rejected = true;
+    for (MapEncoding encoding : {MapEncoding::Raw, MapEncoding::RLE}) {
+        Grid loaded;
+        writeMapFile(path, grid, 1, GenerationParams{}, encoding);
+        std::vector<char> bytes;
+        if (std::FILE* file = std::fopen(path.c_str(), "rb")) {
+            char buffer[4096];
+            for (size_t n; (n = std::fread(buffer, 1, sizeof(buffer), file)) > 0;) bytes.insert(bytes.end(), buffer, buffer + n);
+            std::fclose(file);
+        }
+        auto rewrite = [&](const std::vector<char>& content) {
+            if (std::FILE* file = std::fopen(path.c_str(), "wb")) {
+                std::fwrite(content.data(), 1, content.size(), file);
+                std::fclose(file);
+            }
+        };
+        std::vector<char> corrupt = bytes;
+        corrupt[sizeof(MapFileHeader) + 5] ^= 0x10;
+        rewrite(corrupt);
+        rejected = rejected && !readMapFile(path, loaded);
+        rewrite(std::vector<char>(bytes.begin(), bytes.end() - 3));
+        rejected = rejected && !readMapFile(path, loaded);
+        rewrite(std::vector<char>(bytes.begin(), bytes.begin() + 40));
+        rejected = rejected && !readMapFile(path, loaded);
+        // Dimensiones enormes con la carga útil intacta (en RLE el tamaño no las acota)
+        std::vector<char> huge = bytes;
+        MapFileHeader header;
+        std::memcpy(&header, huge.data(), sizeof(header));
+        header.width = header.height = 0x7FFFFFFFu;
+        std::memcpy(huge.data(), &header, sizeof(header));
+        rewrite(huge);
+        rejected = rejected && !readMapFile(path, loaded);
     }
+    std::remove(path.c_str());
+    std::cout << "Round-trip: " << passed << "/" << total << " maps identical "
+              << (passed == total ? "[PASS]" : "[FAIL]") << std::endl;
+    std::cout << "Corrupt or truncated files: " << (rejected ? "rejected [PASS]" : "accepted [FAIL]") << std::endl;
+}
 
-    // Direcciones: Norte, Este, Sur, Oeste
-    std::vector<std::pair<int, int>> directions = {{-1,0},{0,1},{1,0},{0,-1}};
-    double roomProb = probGenerateRoom;
-    double dirProb = probChangeDirection;
-    int dir = dirDist(rng);
-
-    std::cout << "Drunk Agent starting at position (" << agentX << ", " << agentY << ")" << std::endl;
-
-    for (int j = 0; j < J; ++j) {
-        std::cout << "Movement " << j + 1 << " of " << J << std::endl;
-        
-        // Al final de cada movimiento, intentar generar habitación
-        if (chance(rng) < roomProb) {
-            std::cout << "  Generating room at (" << agentX << ", " << agentY << ")" << std::endl;
-            
-            // Generar habitación centrada en el agente
-            int startX = std::max(0, agentX - roomSizeX / 2);
-            int startY = std::max(0, agentY - roomSizeY / 2);
-            int endX = std::min(H - 1, startX + roomSizeX - 1);
-            int endY = std::min(W - 1, startY + roomSizeY - 1);
+// Función para verificar que el renderizado por tablas da los mismos bytes que
+// el dibujo celda por celda (ASCII, PBM y PGM, ambos almacenamientos)
+void testRenderer() {
+    std::cout << "\n=== TESTING MAP RENDERER ===" << std::endl;
+    ScopedLogLevel quiet(LogLevel::Silent);
+    const int sizes[][2] = {{1, 1}, {7, 3}, {8, 2}, {25, 15}, {64, 5}, {131, 67}};
+    int passed = 0, total = 0;
+    for (const auto& size : sizes) {
+        const int W = size[0], H = size[1];
+        for (Grid::Storage storage : {Grid::Storage::Bits, Grid::Storage::Bytes}) {
+            Grid grid(W, H, storage);
+            initializeWithNoise(grid, 0.45, deriveSeed(21, W * 131 + H), nullptr);
 
-            for (int x = startX; x <= endX; ++x) {
-                for (int y = startY; y <= endY; ++y) {
-                    newMap[x][y] = 1;
+            std::string ascii = "--- Current Map ---\n";
+            std::string pbm = "P4\n" + std::to_string(W) + " " + std::to_string(H) + "\n";
+            std::string pgm = "P5\n" + std::to_string(W) + " " + std::to_string(H) + "\n255\n";
+            for (int i = 0; i < H; ++i) {
+                for (int j = 0; j < W; ++j) {
+                    ascii += grid.get(i, j) ? "# " : ". ";
+                    pgm += static_cast<char>(grid.get(i, j) ? 0 : 255);
+                }
+                ascii += '\n';
+                for (int j = 0; j < W; j += 8) {
+                    int byte = 0;
+                    for (int b = 0; b < 8; ++b) byte |= (j + b < W && grid.get(i, j + b)) << (7 - b);
+                    pbm += static_cast<char>(byte);
                 }
             }
+            ascii += "-------------------\n";
 
-            roomProb = probGenerateRoom;  // Resetear probabilidad
-        } else {
-            roomProb = std::min(1.0, roomProb + probIncreaseRoom);  // Aumentar probabilidad
-        }
-
-        // Decidir cambio de dirección
-        if (chance(rng) < dirProb) {
-            dir = dirDist(rng);
-            dirProb = probChangeDirection;  // Resetear probabilidad
-            std::cout << "  Agent changed direction" << std::endl;
-        } else {
-            dirProb = std::min(1.0, dirProb + probIncreaseChange);  // Aumentar probabilidad
+            std::vector<char> frame;
+            renderAscii(grid, frame);
+            bool same = std::string(frame.begin(), frame.end()) == ascii;
+            renderAscii(grid.toMap(), frame);
+            same = same && std::string(frame.begin(), frame.end()) == ascii;
+            renderImage(grid, ImageFormat::PBM, frame);
+            same = same && std::string(frame.begin(), frame.end()) == pbm;
+            renderImage(grid, ImageFormat::PGM, frame);
+            same = same && std::string(frame.begin(), frame.end()) == pgm;
+            ++total;
+            if (same) ++passed;
         }
+    }
+    std::cout << "Rendered frames: " << passed << "/" << total << " identical to per-cell output "
+              << (passed == total ? "[PASS]" : "[FAIL]") << std::endl;
+}
 
-        // Realizar I pasos en la dirección actual
-        for (int i = 0; i < I; ++i) {
-            int nextX = agentX + directions[dir].first;
-            int nextY = agentY + directions[dir].second;
+// Función para verificar que el avance en forma cerrada de los agentes da el
+// mismo mapa, la misma posición final y el mismo consumo aleatorio que paso a paso
+void testWalkFastForward() {
+    std::cout << "\n=== TESTING AGENT FAST-FORWARD ===" << std::endl;
+    ScopedLogLevel quiet(LogLevel::Silent);
+    int passed = 0, total = 0;
+    const int sizes[][2] = {{1, 1}, {1, 9}, {7, 1}, {25, 15}, {64, 64}, {97, 41}};
+    for (const auto& size : sizes) {
+        for (int I : {1, 4, 30, 200}) {
+            for (uint64_t s = 0; s < 6; ++s) {
+                const uint64_t seed = deriveSeed(777, s * 131 + I);
+                const int W = size[0], H = size[1];
+                Grid stepwise(W, H), fast(W, H);
+                enhancedDrunkAgent(stepwise, 25, I, 3, 4, 0.2, 0.1, 0.3, 0.08, seed, WalkMode::Stepwise);
+                enhancedDrunkAgent(fast, 25, I, 3, 4, 0.2, 0.1, 0.3, 0.08, seed, WalkMode::FastForward);
+                bool same = stepwise.sameCells(fast);
 
-            // Verificar límites del mapa
-            if (nextX < 0 || nextX >= H || nextY < 0 || nextY >= W) {
-                // Cambiar dirección cuando se sale del mapa
-                dir = dirDist(rng);
-                std::cout << "  Agent hit boundary, changing direction" << std::endl;
-                continue;
+                // drunkAgent continúa tras cada choque y conserva la posición entre llamadas
+                int sx = -1, sy = -1, fx = -1, fy = -1;
+                for (int call = 0; call < 2; ++call) {
+                    drunkAgent(stepwise, 25, I, 4, 3, 0.2, 0.1, 0.3, 0.08, sx, sy,
+                               deriveSeed(seed, call), WalkMode::Stepwise);
+                    drunkAgent(fast, 25, I, 4, 3, 0.2, 0.1, 0.3, 0.08, fx, fy,
+                               deriveSeed(seed, call), WalkMode::FastForward);
+                }
+                same = same && sx == fx && sy == fy && stepwise.sameCells(fast);
+                ++total;
+                if (same) ++passed;
             }
-
-            // Mover agente y marcar el camino
-            agentX = nextX;
-            agentY = nextY;
-            newMap[agentX][agentY] = 1;  // Marcar pasillo
         }
     }
-
-    std::cout << "Drunk Agent finished at position (" << agentX << ", " << agentY << ")" << std::endl;
-    return newMap;
+    std::cout << "Fast-forward vs stepwise walks: " << passed << "/" << total << " maps identical "
+              << (passed == total ? "[PASS]" : "[FAIL]") << std::endl;
 }
 
-// Versión mejorada del Drunk Agent con mejor control de probabilidades
-Map enhancedDrunkAgent(Map& currentMap, int W, int H, int J, int I, int roomSizeX, int roomSizeY,
-                      double A, double B, double C, double D) {
-    
-    std::mt19937 rng(std::chrono::steady_clock::now().time_since_epoch().count());
-    std::uniform_real_distribution<double> chance(0.0, 1.0);
-    std::uniform_int_distribution<int> dirDist(0, 3);
-    std::uniform_int_distribution<int> xDist(0, H - 1);
-    std::uniform_int_distribution<int> yDist(0, W - 1);
-
-    // Posición inicial aleatoria
-    int agentX = xDist(rng);
-    int agentY = yDist(rng);
-    
-    // Direcciones: Norte, Este, Sur, Oeste
-    std::vector<std::pair<int, int>> directions = {{-1,0},{0,1},{1,0},{0,-1}};
-    std::vector<std::string> dirNames = {"North", "East", "South", "West"};
-    
-    double roomProb = A;        // Probabilidad actual de generar habitación
-    double dirProb = C;         // Probabilidad actual de cambiar dirección
-    int currentDir = dirDist(rng);
+// Función para verificar el relleno por tramos contra el marcado celda a celda,
+// con rectángulos que cruzan palabras y se salen de la grilla
+void testSpanFill() {
+    std::cout << "\n=== TESTING SPAN FILL ===" << std::endl;
+    std::mt19937 rng(11);
+    int passed = 0, total = 0;
+    for (Grid::Storage storage : {Grid::Storage::Bits, Grid::Storage::Bytes}) {
+        for (int W : {1, 63, 64, 65, 130, 200}) {
+            for (int trial = 0; trial < 40; ++trial) {
+                const int H = 1 + static_cast<int>(rng() % 20);
+                Grid expected(W, H, storage), plain(W, H, storage), atomic(W, H, storage);
+                int x0 = static_cast<int>(rng() % (H + 4)) - 2, x1 = x0 + static_cast<int>(rng() % 8) - 1;
+                int y0 = static_cast<int>(rng() % (W + 8)) - 4, y1 = y0 + static_cast<int>(rng() % 150) - 1;
+                for (int x = x0; x <= x1; ++x) {
+                    for (int y = y0; y <= y1; ++y) {
+                        if (expected.inBounds(x, y)) expected.set(x, y, 1);
+                    }
+                }
+                fillRect(plain, x0, y0, x1, y1);
+                fillRect<true>(atomic, x0, y0, x1, y1);
+                // Un tramo vertical y otro horizontal en orden invertido
+                const int col = static_cast<int>(rng() % W), row = static_cast<int>(rng() % H);
+                for (int x = 0; x < H; ++x) expected.set(x, col, 1);
+                for (int y = 0; y < W; ++y) expected.set(row, y, 1);
+                fillSegment(plain, H + 3, col, -3, col);
+                fillSegment<true>(atomic, row, W - 1, row, 0);
+                fillSegment<true>(atomic, 0, col, H - 1, col);
+                fillSegment(plain, row, W + 5, row, -1);
+                ++total;
+                if (plain.sameCells(expected) && atomic.sameCells(expected)) ++passed;
+            }
+        }
+    }
+    std::cout << "Span fill vs per-cell marking: " << passed << "/" << total << " grids identical "
+              << (passed == total ? "[PASS]" : "[FAIL]") << std::endl;
+}
 
-    std::cout << "\n=== Enhanced Drunk Agent Starting ===" << std::endl;
-    std::cout << "Initial position: (" << agentX << ", " << agentY << ")" << std::endl;
-    std::cout << "Parameters: J=" << J << ", I=" << I << ", Room=" << roomSizeX << "x" << roomSizeY << std::endl;
-    std::cout << "Probabilities: A=" << A << ", B=" << B << ", C=" << C << ", D=" << D << std::endl;
+// Función para verificar los agentes simultáneos: el resultado es la unión de
+// los recorridos individuales y no depende del número de hilos
+void testMultiAgentWalkers() {
+    std::cout << "\n=== TESTING MULTI-AGENT DRUNK WALK ===" << std::endl;
+    ScopedLogLevel quiet(LogLevel::Silent);
+    const int K = 12, J = 40, I = 9;
+    const uint64_t seed = 4242;
 
-    for (int j = 0; j < J; ++j) {
-        std::cout << "\n--- Movement Phase " << (j + 1) << "/" << J << " ---" << std::endl;
-        std::cout << "Current room probability: " << roomProb << std::endl;
-        std::cout << "Current direction change probability: " << dirProb << std::endl;
-        
-        // Decidir si cambiar dirección al inicio de cada movimiento
-        if (chance(rng) < dirProb) {
-            int newDir = dirDist(rng);
-            std::cout << "Direction changed from " << dirNames[currentDir] 
-                     << " to " << dirNames[newDir] << std::endl;
-            currentDir = newDir;
-            dirProb = C;  // Resetear probabilidad de cambio de dirección
-        } else {
-            dirProb = std::min(1.0, dirProb + D);  // Aumentar probabilidad
-            std::cout << "Direction maintained: " << dirNames[currentDir] << std::endl;
+    bool ok = true;
+    for (Grid::Storage storage : {Grid::Storage::Bits, Grid::Storage::Bytes}) {
+        // Unión de los K agentes corridos uno por uno
+        Grid expected(150, 90, storage);
+        for (int k = 0; k < K; ++k) {
+            CounterRng rng(seed, RngStage::EnhancedDrunkAgent, k);
+            GridMarker marker{expected};
+            enhancedDrunkWalk(marker, 150, 90, J, I, 5, 4, 0.2, 0.1, 0.3, 0.08, rng);
         }
+        for (int threads : {1, 3, 8}) {
+            ThreadPool pool(threads);
+            Grid grid(150, 90, storage);
+            multiAgentDrunkWalk(grid, K, J, I, 5, 4, 0.2, 0.1, 0.3, 0.08, seed, &pool);
+            ok = ok && grid.sameCells(expected);
+        }
+        // Sin pool: los mismos agentes en el hilo actual
+        Grid serial(150, 90, storage);
+        multiAgentDrunkWalk(serial, K, J, I, 5, 4, 0.2, 0.1, 0.3, 0.08, seed, nullptr);
+        ok = ok && serial.sameCells(expected);
+    }
 
-        // Realizar I pasos en la dirección actual
-        for (int i = 0; i < I; ++i) {
-            int nextX = agentX + directions[currentDir].first;
-            int nextY = agentY + directions[currentDir].second;
-
-            // Verificar límites y detener si se sale del mapa
-            if (nextX < 0 || nextX >= H || nextY < 0 || nextY >= W) {
-                std::cout << "  Hit boundary at step " << (i + 1) << ", stopping movement" << std::endl;
-                // Cambiar dirección cuando se sale del mapa
-                currentDir = dirDist(rng);
-                break;
-            }
+    // Un solo agente es el Drunk Agent mejorado con la misma semilla
+    Grid single(60, 40), multi(60, 40);
+    enhancedDrunkAgent(single, J, I, 5, 4, 0.2, 0.1, 0.3, 0.08, seed);
+    multiAgentDrunkWalk(multi, 1, J, I, 5, 4, 0.2, 0.1, 0.3, 0.08, seed);
+    ok = ok && single.sameCells(multi);
 
-            // Mover agente y marcar el camino (pasillo)
-            agentX = nextX;
-            agentY = nextY;
-            currentMap[agentX][agentY] = 1;
-        }
+    std::cout << K << " agents with no pool and 1/3/8 threads, both storages: "
+              << (ok ? "union of single walks [PASS]" : "mismatch [FAIL]") << std::endl;
+}
 
-        std::cout << "Agent position after movement: (" << agentX << ", " << agentY << ")" << std::endl;
+int main(int argc, char** argv) {
+    // Semilla de toda la simulación: --seed N la fija para reproducir un mapa
+    uint64_t seed = randomSeed();
+    int threads = ThreadPool::hardwareThreads();
+    int batchJobs = 0;
+    int batchWidth = 25;
+    int batchHeight = 15;
+    int benchMaxSize = 0;
+    std::string benchOut;
+    bool chunked = false;
+    ChunkedMapParams chunkParams;
+    std::string savePath;
+    std::string loadPath;
+    std::string imagePath;
+    int searchCandidates = -1;
+    int searchTop = 5;
+    MapEncoding saveEncoding = MapEncoding::Raw;
 
-        // Al final del movimiento, intentar generar habitación
-        if (chance(rng) < roomProb) {
-            std::cout << "Generating room at (" << agentX << ", " << agentY << ")" << std::endl;
-            
-            // Calcular límites de la habitación centrada en el agente
-            int startX = std::max(0, agentX - roomSizeY / 2);
-            int startY = std::max(0, agentY - roomSizeX / 2);
-            int endX = std::min(H - 1, agentX + (roomSizeY - 1) / 2);
-            int endY = std::min(W - 1, agentY + (roomSizeX - 1) / 2);
+    // Perfil por etapas: --profile FILE (JSON) y/o --profile-trace FILE (trace de
+    // Chrome). Se escriben al salir de main, sea cual sea el modo
+    struct ProfileOutput {
+        std::string jsonPath;
+        std::string tracePath;
 
-            // Asegurar que la habitación se genere incluso cerca del borde
-            if (endX - startX + 1 < roomSizeY || endY - startY + 1 < roomSizeX) {
-                // Ajustar para que la habitación tenga el tamaño mínimo
-                if (endX - startX + 1 < roomSizeY) {
-                    if (startX > 0) startX = std::max(0, endX - roomSizeY + 1);
-                    else endX = std::min(H - 1, startX + roomSizeY - 1);
-                }
-                if (endY - startY + 1 < roomSizeX) {
-                    if (startY > 0) startY = std::max(0, endY - roomSizeX + 1);
-                    else endY = std::min(W - 1, startY + roomSizeX - 1);
-                }
+        ~ProfileOutput() {
+            if (jsonPath.empty() && tracePath.empty()) return;
+            const ProfileReport report = Profiler::instance().report();
+            if (!jsonPath.empty()) {
+                std::ofstream out(jsonPath);
+                if (out) report.writeJson(out);
+                else std::cerr << "Could not open " << jsonPath << std::endl;
+            }
+            if (!tracePath.empty()) {
+                std::ofstream out(tracePath);
+                if (out) report.writeChromeTrace(out);
+                else std::cerr << "Could not open " << tracePath << std::endl;
             }
+        }
+    } profileOutput;
 
-            // Generar la habitación
-            for (int x = startX; x <= endX; ++x) {
-                for (int y = startY; y <= endY; ++y) {
-                    currentMap[x][y] = 1;
-                }
+    // Opciones por línea de comandos
+    for (int a = 1; a < argc; ++a) {
+        std::string arg = argv[a];
+        if (arg == "--seed" && a + 1 < argc) {
+            seed = std::strtoull(argv[++a], nullptr, 10);
+        } else if (arg == "--quiet") {
+            setLogLevel(LogLevel::Silent);
+        } else if (arg == "--log-level" && a + 1 < argc) {
+            setLogLevel(static_cast<LogLevel>(std::max(0, std::min(2, std::atoi(argv[++a])))));
+        } else if (arg == "--trace" && a + 1 < argc) {
+            if (!TraceSink::instance().open(argv[++a])) {
+                std::cerr << "Could not open trace file " << argv[a] << std::endl;
+                return 1;
+            }
+        } else if (arg == "--threads" && a + 1 < argc) {
+            threads = std::max(1, std::atoi(argv[++a]));
+        } else if (arg == "--size" && a + 1 < argc) {
+            int width = 0, height = 0;
+            char extra = 0;
+            if (std::sscanf(argv[++a], "%dx%d%c", &width, &height, &extra) != 2 || width < 0 || height < 0) {
+                std::cerr << "Invalid size " << argv[a] << ", expected WxH with W, H >= 0" << std::endl;
+                return 1;
             }
+            batchWidth = width;
+            batchHeight = height;
+        } else if (arg == "--batch" && a + 1 < argc) {
+            batchJobs = std::max(0, std::atoi(argv[++a]));
+        } else if (arg == "--bench") {
+            benchMaxSize = 4096;
+        } else if (arg == "--max-size" && a + 1 < argc) {
+            benchMaxSize = std::max(64, std::atoi(argv[++a]));
+        } else if (arg == "--bench-out" && a + 1 < argc) {
+            benchOut = argv[++a];
+        } else if (arg == "--chunked") {
+            chunked = true;
+        } else if (arg == "--chunk-size" && a + 1 < argc) {
+            chunkParams.chunkSize = std::max(64, std::atoi(argv[++a]));
+        } else if (arg == "--chunk-file" && a + 1 < argc) {
+            chunkParams.backingFile = argv[++a];
+        } else if (arg == "--resident" && a + 1 < argc) {
+            chunkParams.maxResidentChunks = std::max(1, std::atoi(argv[++a]));
+        } else if (arg == "--save" && a + 1 < argc) {
+            savePath = argv[++a];
+        } else if (arg == "--rle") {
+            saveEncoding = MapEncoding::RLE;
+        } else if (arg == "--load" && a + 1 < argc) {
+            loadPath = argv[++a];
+        } else if (arg == "--search" && a + 1 < argc) {
+            searchCandidates = std::max(0, std::atoi(argv[++a]));
+        } else if (arg == "--top" && a + 1 < argc) {
+            searchTop = std::max(1, std::atoi(argv[++a]));
+        } else if (arg == "--image" && a + 1 < argc) {
+            imagePath = argv[++a];
+        } else if (arg == "--profile" && a + 1 < argc) {
+            profileOutput.jsonPath = argv[++a];
+            Profiler::enable(true);
+        } else if (arg == "--profile-trace" && a + 1 < argc) {
+            profileOutput.tracePath = argv[++a];
+            Profiler::enable(true);
+            Profiler::recordEvents(true);
+        } else if (arg == "--bench-temporal") {
+            int size = a + 1 < argc ? std::atoi(argv[a + 1]) : 4096;
+            benchmarkTemporalBlocking(size > 0 ? size : 4096, 1, 4, 8);
+            return 0;
+        }
+    }
 
-            roomProb = A;  // Resetear probabilidad de habitación
-            std::cout << "Room generated: " << (endX - startX + 1) << "x" << (endY - startY + 1) << std::endl;
+    // Suite de benchmarks: --bench [--max-size N] [--bench-out FILE] [--threads T]
+    // Escribe JSON en FILE (o en la salida estándar); el progreso va a stderr
+    if (benchMaxSize > 0) {
+        ThreadPool pool(threads);
+        if (benchOut.empty()) {
+            runBenchmarks(benchMaxSize, pool, std::cout);
         } else {
-            roomProb = std::min(1.0, roomProb + B);  // Aumentar probabilidad
-            std::cout << "No room generated. New room probability: " << roomProb << std::endl;
+            std::ofstream out(benchOut);
+            if (!out) {
+                std::cerr << "Could not open " << benchOut << std::endl;
+                return 1;
+            }
+            runBenchmarks(benchMaxSize, pool, out);
         }
+        return 0;
     }
 
-    std::cout << "\n=== Enhanced Drunk Agent Finished ===" << std::endl;
-    std::cout << "Final position: (" << agentX << ", " << agentY << ")" << std::endl;
-    
-    return currentMap;
-}
-
-// Función para probar diferentes configuraciones del Drunk Agent
-void testDrunkAgentConfigurations() {
-    std::cout << "\n=== TESTING DIFFERENT DRUNK AGENT CONFIGURATIONS ===" << std::endl;
-    
-    // Configuración 1: Agente conservador (pocas habitaciones, pocos cambios de dirección)
-    {
-        std::cout << "\n--- Configuration 1: Conservative Agent ---" << std::endl;
-        int W = 20, H = 15;
-        Map map1(H, std::vector<int>(W, 0));
-        
-        std::cout << "Initial empty map:" << std::endl;
-        printMap(map1);
-        
-        map1 = enhancedDrunkAgent(map1, W, H, 6, 8, 3, 3, 0.1, 0.03, 0.15, 0.02);
-        
-        std::cout << "Final conservative agent map:" << std::endl;
-        printMap(map1);
-        
-        int filled = 0;
-        for (const auto& row : map1) {
-            for (int cell : row) if (cell == 1) filled++;
+    // Lectura de un mapa guardado: --load FILE [--image OUT.pgm|OUT.pbm]. Muestra la
+    // cabecera, verifica la suma de verificación y dibuja el mapa si es pequeño
+    if (!loadPath.empty()) {
+        MappedMapFile file;
+        if (!file.open(loadPath)) {
+            std::cerr << "Could not open " << loadPath << " as a map file" << std::endl;
+            return 1;
         }
-        std::cout << "Fill percentage: " << (100.0 * filled / (W * H)) << "%" << std::endl;
+        const MapFileHeader& header = file.header();
+        Grid grid;
+        auto start = std::chrono::steady_clock::now();
+        const bool ok = file.toGrid(grid);
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        std::cout << "Map: " << header.width << "x" << header.height << " ("
+                  << (file.encoding() == MapEncoding::RLE ? "RLE" : "raw") << ", " << header.payloadBytes
+                  << " payload bytes), seed " << header.seed << std::endl;
+        std::cout << "Params: noise " << header.noiseDensity << ", " << header.outerIterations
+                  << " iterations, CA R=" << header.caR << " U=" << header.caU << " x" << header.caIterations
+                  << ", agent J=" << header.agentJ << " I=" << header.agentI << " room " << header.roomSizeX
+                  << "x" << header.roomSizeY << std::endl;
+        std::cout << "Checksum: " << std::hex << header.checksum << std::dec << (ok ? " [OK]" : " [MISMATCH]")
+                  << ", decoded in " << seconds << " s" << std::endl;
+        if (ok && grid.width() <= 200 && grid.height() <= 100) printMap(grid);
+        if (ok && !imagePath.empty()) {
+            const bool pbm = imagePath.size() >= 4 && imagePath.compare(imagePath.size() - 4, 4, ".pbm") == 0;
+            if (!writeImage(imagePath, grid, pbm ? ImageFormat::PBM : ImageFormat::PGM)) {
+                std::cerr << "Could not write " << imagePath << std::endl;
+                return 1;
+            }
+            std::cout << "Image written to " << imagePath << std::endl;
+        }
+        return ok ? 0 : 1;
     }
-    
-    // Configuración 2: Agente agresivo (muchas habitaciones, muchos cambios)
-    {
-        std::cout << "\n--- Configuration 2: Aggressive Agent ---" << std::endl;
-        int W = 20, H = 15;
-        Map map2(H, std::vector<int>(W, 0));
-        
-        std::cout << "Initial empty map:" << std::endl;
-        printMap(map2);
-        
-        map2 = enhancedDrunkAgent(map2, W, H, 10, 4, 5, 4, 0.3, 0.15, 0.4, 0.1);
-        
-        std::cout << "Final aggressive agent map:" << std::endl;
-        printMap(map2);
-        
-        int filled = 0;
-        for (const auto& row : map2) {
-            for (int cell : row) if (cell == 1) filled++;
+
+    // Generación por trozos: --chunked --size WxH [--chunk-size N] [--chunk-file FILE]
+    // [--resident N] [--threads T] [--seed S]. Recorre todo el mapa en streaming
+    // (ruido + autómata con los parámetros de main()) sin tenerlo entero en memoria
+    if (chunked) {
+        chunkParams.width = batchWidth;
+        chunkParams.height = batchHeight;
+        chunkParams.seed = seed;
+        ThreadPool pool(threads);
+        ChunkedMap map(chunkParams, pool);
+        if (!chunkParams.backingFile.empty() && !map.fileBacked()) {
+            std::cerr << "Could not map " << chunkParams.backingFile << ", chunks will not be stored" << std::endl;
         }
-        std::cout << "Fill percentage: " << (100.0 * filled / (W * H)) << "%" << std::endl;
+        uint64_t floorCells = 0;
+        uint64_t checksum = 0;
+        auto start = std::chrono::steady_clock::now();
+        map.forEachChunk([&](const ChunkView& view) {
+            uint64_t hash = static_cast<uint64_t>(view.row0) * 0x9E3779B97F4A7C15ull + view.col0;
+            for (int i = 0; i < view.height; ++i) {
+                const uint64_t* row = view.words + i * view.strideWords;
+                for (size_t w = 0; w < view.strideWords; ++w) {
+                    floorCells += __builtin_popcountll(row[w]);
+                    hash = mixBits(hash ^ row[w]);
+                }
+            }
+            checksum ^= hash;
+        });
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        double cells = static_cast<double>(map.width()) * map.height();
+        std::cout << "Chunked: " << map.width() << "x" << map.height() << " in " << map.chunksX() * map.chunksY()
+                  << " chunks of " << map.chunkSize() << " on " << pool.size() << " threads (seed " << seed << ")"
+                  << (map.fileBacked() ? ", file-backed" : "") << std::endl;
+        std::cout << "Time: " << seconds << " s, " << cells / seconds << " cells/s, floor "
+                  << (cells > 0 ? 100.0 * floorCells / cells : 0.0) << "%, peak RSS " << peakRssKB() << " KB"
+                  << std::endl;
+        std::cout << "Chunked checksum: " << std::hex << checksum << std::dec << std::endl;
+        return 0;
     }
-    
-    // Configuración 3: Agente equilibrado
-    {
-        std::cout << "\n--- Configuration 3: Balanced Agent ---" << std::endl;
-        int W = 20, H = 15;
-        Map map3(H, std::vector<int>(W, 0));
-        
-        std::cout << "Initial empty map:" << std::endl;
-        printMap(map3);
-        
-        map3 = enhancedDrunkAgent(map3, W, H, 8, 6, 4, 3, 0.2, 0.08, 0.25, 0.05);
-        
-        std::cout << "Final balanced agent map:" << std::endl;
-        printMap(map3);
-        
-        int filled = 0;
-        for (const auto& row : map3) {
-            for (int cell : row) if (cell == 1) filled++;
+
+    // Búsqueda de parámetros: --search N [--top K] [--threads T] [--size WxH] [--seed S]
+    // Prueba N combinaciones al azar del espacio por defecto (N = 0: todas) y
+    // muestra las K mejores según los objetivos por defecto
+    if (searchCandidates >= 0) {
+        GenerationParams base;
+        base.width = batchWidth;
+        base.height = batchHeight;
+        SearchSpace space;
+        std::vector<MapJob> candidates = searchCandidates == 0 ? gridCandidates(base, space, seed)
+                                                               : randomCandidates(base, space, searchCandidates, seed);
+        WorkStealingPool pool(threads);
+        SearchResult result = searchParameters(candidates, SearchTargets{}, searchTop, pool);
+        std::cout << "Search: " << result.candidates << " candidates of " << batchWidth << "x" << batchHeight
+                  << " on " << pool.size() << " threads (seed " << seed << ") in " << result.seconds << " s" << std::endl;
+        std::cout << "Accepted " << result.accepted << ", rejected " << result.rejected << ", aborted early "
+                  << result.aborted << std::endl;
+        for (const SearchCandidate& c : result.best) {
+            const GenerationParams& p = c.job.params;
+            std::cout << "  score " << c.score << ": fill " << c.fill << "%, connectivity " << c.connectivity
+                      << ", " << c.regions << " regions, " << c.rooms << " rooms | A=" << p.A << " B=" << p.B
+                      << " C=" << p.C << " D=" << p.D << " R=" << p.caR << " U=" << p.caU << " room="
+                      << p.roomSizeX << " seed=" << c.job.seed << std::endl;
         }
-        std::cout << "Fill percentage: " << (100.0 * filled / (W * H)) << "%" << std::endl;
+        return 0;
     }
-}
 
-// Función para probar solo el autómata celular con diferentes enfoques
-void testCellularAutomataOnly() {
-    std::cout << "\n=== TESTING CELLULAR AUTOMATA ONLY ===" << std::endl;
-    
-    int W = 25, H = 15;
-    Map map = initializeWithNoise(W, H, 0.42);
-    
-    std::cout << "\nInitial random map:" << std::endl;
-    printMap(map);
-    
-    // Aplicar iteraciones una por una para ver la evolución
-    std::cout << "\n--- Cellular Automata Evolution ---" << std::endl;
-    for (int i = 1; i <= 5; ++i) {
-        map = cellularAutomata(map, W, H, 1, 4, 1); // 1 iteración a la vez
-        
-        std::cout << "\nAfter iteration " << i << ":" << std::endl;
-        printMap(map);
-        
-        // Calcular estadísticas
-        int filled = 0;
-        for (const auto& row : map) {
-            for (int cell : row) if (cell == 1) filled++;
+    // Modo por lotes: --batch N [--threads T] [--size WxH] [--seed S]
+    // El trabajo k usa la semilla deriveSeed(S, k) y los parámetros de main()
+    if (batchJobs > 0) {
+        std::vector<MapJob> jobs(batchJobs);
+        for (int k = 0; k < batchJobs; ++k) {
+            jobs[k].seed = deriveSeed(seed, k);
+            jobs[k].params.width = batchWidth;
+            jobs[k].params.height = batchHeight;
         }
-        std::cout << "Fill percentage: " << (100.0 * filled / (W * H)) << "%" << std::endl;
+        std::vector<uint64_t> checksums(batchJobs);
+        WorkStealingPool pool(threads);
+        BatchStats stats = runBatch(jobs, pool, [&](int job, const Grid& grid) {
+            checksums[job] = gridChecksum(grid);
+        });
+        uint64_t combined = 0;
+        for (int k = 0; k < batchJobs; ++k) combined ^= mixBits(checksums[k] + k);
+
+        std::cout << "Batch: " << stats.maps << " maps of " << batchWidth << "x" << batchHeight
+                  << " on " << pool.size() << " threads (seed " << seed << ")" << std::endl;
+        std::cout << "Time: " << stats.seconds << " s, " << stats.mapsPerSecond << " maps/s, "
+                  << stats.cellsPerSecond << " cells/s, " << stats.steals << " steals" << std::endl;
+        std::cout << "Batch checksum: " << std::hex << combined << std::dec << std::endl;
+        return 0;
     }
-    
-    // Probar con diferentes parámetros
-    std::cout << "\n--- Testing Different Parameters ---" << std::endl;
-    
-    // Prueba con umbral más alto
-    Map map2 = initializeWithNoise(W, H, 0.5);
-    std::cout << "\nHigh threshold test (U=6):" << std::endl;
-    std::cout << "Initial map:" << std::endl;
-    printMap(map2);
-    
-    map2 = cellularAutomata(map2, W, H, 1, 6, 3);
-    std::cout << "After 3 iterations with U=6:" << std::endl;
-    printMap(map2);
-    
-    // Prueba con umbral más bajo
-    Map map3 = initializeWithNoise(W, H, 0.3);
-    std::cout << "\nLow threshold test (U=2):" << std::endl;
-    std::cout << "Initial map:" << std::endl;
-    printMap(map3);
-    
-    map3 = cellularAutomata(map3, W, H, 1, 2, 3);
-    std::cout << "After 3 iterations with U=2:" << std::endl;
-    printMap(map3);
-}
 
-int main() {
     std::cout << "--- CELLULAR AUTOMATA AND DRUNK AGENT SIMULATION ---" << std::endl;
+    std::cout << "Seed: " << seed << std::endl;
 
     int mapRows = 15;
     int mapCols = 25;
-    
+
+    // Todas las etapas trabajan sobre los buffers de la arena del pipeline, sin
+    // copias de Map entre una y otra
+    MapPipeline pipeline;
+
     // Inicializar con ruido aleatorio para el autómata celular
-    Map myMap = initializeWithNoise(mapCols, mapRows, 0.45);
+    pipeline.reset(mapCols, mapRows).noise(0.45, seed);
 
     std::cout << "\nInitial map state (random noise):" << std::endl;
-    printMap(myMap);
+    printMap(pipeline.grid());
 
     int numIterations = 3;
 
     // Parámetros de Cellular Automata
-    int ca_W = mapCols;
-    int ca_H = mapRows;
     int ca_R = 1;        // Radio del vecindario
     int ca_U = 4;        // Umbral de vecinos (cambiado a int)
     int ca_iterations = 2; // Iteraciones del autómata
 
     // Parámetros del Drunk Agent
-    int da_W = mapCols;
-    int da_H = mapRows;
     int da_J = 6;        // Número de movimientos
     int da_I = 4;        // Pasos por movimiento
     int da_roomSizeX = 3; // Ancho de habitación
@@ -535,41 +6876,85 @@ int main() {
         std::cout << "\n========== Iteration " << iteration + 1 << " ==========" << std::endl;
 
         // Paso del autómata celular
-        myMap = cellularAutomata(myMap, ca_W, ca_H, ca_R, ca_U, ca_iterations);
+        pipeline.cellularAutomata(ca_R, ca_U, ca_iterations);
 
         std::cout << "\nMap after Cellular Automata:" << std::endl;
-        printMap(myMap);
+        printMap(pipeline.grid());
 
         // Usar la versión mejorada del agente borracho
-        myMap = enhancedDrunkAgent(myMap, da_W, da_H, da_J, da_I, da_roomSizeX, da_roomSizeY,
-                                  da_probGenerateRoom, da_probIncreaseRoom,
-                                  da_probChangeDirection, da_probIncreaseChange);
+        pipeline.enhancedDrunkAgent(da_J, da_I, da_roomSizeX, da_roomSizeY,
+                                    da_probGenerateRoom, da_probIncreaseRoom,
+                                    da_probChangeDirection, da_probIncreaseChange,
+                                    deriveSeed(seed, iteration));
 
         std::cout << "\nMap after Drunk Agent:" << std::endl;
-        printMap(myMap);
+        printMap(pipeline.grid());
     }
 
     std::cout << "\n--- Simulation Finished ---" << std::endl;
     
     // Estadísticas finales
     int totalCells = mapRows * mapCols;
-    int filledCells = 0;
-    for (const auto& row : myMap) {
-        for (int cell : row) {
-            if (cell == 1) filledCells++;
-        }
-    }
+    const MapStats stats = pipeline.analyze();
+    const int filledCells = static_cast<int>(stats.filled);
     
     std::cout << "Final Statistics:" << std::endl;
     std::cout << "Total cells: " << totalCells << std::endl;
     std::cout << "Filled cells: " << filledCells << std::endl;
     std::cout << "Fill percentage: " << (100.0 * filledCells / totalCells) << "%" << std::endl;
+    std::cout << "Regions: " << stats.regionCount() << ", largest " << stats.largestRegion() << " cells" << std::endl;
+
+    // Guardar el mapa final: --save FILE [--rle]
+    if (!savePath.empty()) {
+        GenerationParams params;
+        params.width = mapCols;
+        params.height = mapRows;
+        params.outerIterations = numIterations;
+        params.caR = ca_R;
+        params.caU = ca_U;
+        params.caIterations = ca_iterations;
+        params.agentJ = da_J;
+        params.agentI = da_I;
+        params.roomSizeX = da_roomSizeX;
+        params.roomSizeY = da_roomSizeY;
+        params.A = da_probGenerateRoom;
+        params.B = da_probIncreaseRoom;
+        params.C = da_probChangeDirection;
+        params.D = da_probIncreaseChange;
+        if (writeMapFile(savePath, pipeline.grid(), seed, params, saveEncoding)) {
+            std::cout << "Saved map to " << savePath << std::endl;
+        } else {
+            std::cerr << "Could not write " << savePath << std::endl;
+        }
+    }
     
     // Probar diferentes configuraciones del agente
-    testDrunkAgentConfigurations();
+    testDrunkAgentConfigurations(deriveSeed(seed, 100));
     
     // Probar solo el autómata celular
-    testCellularAutomataOnly();
+    testCellularAutomataOnly(deriveSeed(seed, 200));
+
+    // Verificar la equivalencia de los modos de conteo de vecinos
+    testNeighborCountingModes();
+    testBitboardKernel();
+    testSpecializedKernels();
+    testParallelCellularAutomata();
+    testMapStats();
+    testMultiStateCellularAutomata();
+    testTemporalBlocking();
+    testIncrementalCellularAutomata();
+    testSeedReproducibility();
+    testChunkedMap();
+    testMapFile();
+    testNoiseFill();
+    testBatchGeneration();
+    testPipelineArena();
+    testProfiler();
+    testParameterSearch();
+    testMultiAgentWalkers();
+    testSpanFill();
+    testWalkFastForward();
+    testRenderer();
     
     return 0;
 }